@@ -49,6 +49,10 @@ public:
         }
     }
     
+    void setLumaOnly(bool luma_only) {
+        g_object_set(decoder, "luma-only", luma_only ? TRUE : FALSE, NULL);
+    }
+    
     void setupPipeline(const std::string& output_format) {
         // Create caps for appsrc (JPEG input) - fix sentinel warning
         GstCaps* input_caps = gst_caps_new_simple("image/jpeg", NULL, NULL);
@@ -164,6 +168,8 @@ static size_t getFrameSize(int width, int height, const std::string& format) {
         return width * height * 3;
     } else if (format == "I420") {
         return width * height * 3 / 2;
+    } else if (format == "GRAY8") {
+        return width * height;
     }
     return 0;
 }
@@ -479,6 +485,72 @@ static void BM_GstDecodeRGB_PatternVariations(benchmark::State& state) {
     g_benchmark.reset();
 }
 
+// Colour JPEG decoded to GRAY8 in luma-only mode, against the RGB and I420
+// decodes of the same files above
+static void BM_GstDecodeGRAY8_LumaOnly(benchmark::State& state) {
+    const int resolution = state.range(0);
+    const std::string format = "GRAY8";
+    
+    int width, height;
+    std::string jpeg_file;
+    std::string resolution_name;
+    switch (resolution) {
+        case 0:
+            width = 1280;
+            height = 720;
+            jpeg_file = "test_patterns/smpte_color_bars_720p_smpte_color_bars_rgb.jpg";
+            resolution_name = "720p";
+            break;
+        case 1:
+            width = 1920;
+            height = 1080;
+            jpeg_file = "test_patterns/smpte_color_bars_1080p_smpte_color_bars_rgb.jpg";
+            resolution_name = "1080p";
+            break;
+        default:
+            width = 3840;
+            height = 2160;
+            jpeg_file = "test_patterns/smpte_color_bars_4k_smpte_color_bars_rgb.jpg";
+            resolution_name = "4K";
+            break;
+    }
+    
+    g_benchmark.reset(new GstreamerDecoderBenchmark());
+    
+    if (!g_benchmark->loadJpegFile(jpeg_file)) {
+        state.SkipWithError(("Failed to load JPEG file: " + jpeg_file).c_str());
+        return;
+    }
+    
+    g_benchmark->setLumaOnly(true);
+    g_benchmark->setupPipeline(format);
+    g_benchmark->resetFrameCount();
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    for (auto _ : state) {
+        g_benchmark->benchmarkDecode();
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    
+    // Validate that we processed exactly one frame per iteration
+    if (g_benchmark->getFramesProcessed() != static_cast<size_t>(state.iterations())) {
+        state.SkipWithError(("Frame count mismatch: expected " + std::to_string(state.iterations()) + 
+                           ", got " + std::to_string(g_benchmark->getFramesProcessed())).c_str());
+        return;
+    }
+    
+    // Calculate metrics
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * getFrameSize(width, height, format));
+    calculateAndSetFPS(state, start_time, end_time);
+    state.SetLabel(resolution_name + " SMPTE JPEG -> " + format + " (luma only)");
+    
+    g_benchmark->cleanup();
+    g_benchmark.reset();
+}
+
 // Register benchmarks
 BENCHMARK(BM_GstDecodeRGB_720p)->Unit(benchmark::kMillisecond);
 BENCHMARK(BM_GstDecodeRGB_1080p)->Unit(benchmark::kMillisecond);
@@ -487,5 +559,6 @@ BENCHMARK(BM_GstDecodeI420_720p)->Unit(benchmark::kMillisecond);
 BENCHMARK(BM_GstDecodeI420_1080p)->Unit(benchmark::kMillisecond);
 BENCHMARK(BM_GstDecodeI420_4K)->Unit(benchmark::kMillisecond);
 BENCHMARK(BM_GstDecodeRGB_PatternVariations)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_GstDecodeGRAY8_LumaOnly)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMillisecond);
 
 BENCHMARK_MAIN();
\ No newline at end of file
@@ -0,0 +1,168 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstturbojpegarena.h"
+
+/* Bookkeeping stored right in front of each aligned block */
+typedef struct
+{
+  gpointer raw;               /* Pointer returned by g_malloc() */
+  gsize size;
+  guint generation;           /* Arena generation the block belongs to */
+} GstTurboJpegArenaBlock;
+
+/* A thread-safe cache of aligned scratch blocks keyed by size. Frames of
+ * one stream all need the same sizes, so after the first frame every
+ * acquire is served from the free list */
+struct _GstTurboJpegArena
+{
+  GMutex lock;
+  GSList *free_blocks;
+  guint generation;
+  guint64 allocated;          /* Bytes currently held, in use or cached */
+  guint64 high_water;
+};
+
+#define BLOCK_HEADER(data) (((GstTurboJpegArenaBlock *) (data)) - 1)
+
+static gpointer
+gst_turbojpeg_arena_alloc_block (GstTurboJpegArena * arena, gsize size)
+{
+  GstTurboJpegArenaBlock *block;
+  gpointer raw;
+  guintptr data;
+
+  raw = g_malloc (size + sizeof (GstTurboJpegArenaBlock) +
+      GST_TURBOJPEG_ARENA_ALIGN - 1);
+  data = ((guintptr) raw + sizeof (GstTurboJpegArenaBlock) +
+      GST_TURBOJPEG_ARENA_ALIGN - 1) & ~((guintptr) GST_TURBOJPEG_ARENA_ALIGN -
+      1);
+
+  block = BLOCK_HEADER (data);
+  block->raw = raw;
+  block->size = size;
+  block->generation = arena->generation;
+
+  arena->allocated += size;
+  arena->high_water = MAX (arena->high_water, arena->allocated);
+
+  return (gpointer) data;
+}
+
+static void
+gst_turbojpeg_arena_free_block (GstTurboJpegArena * arena, gpointer data)
+{
+  GstTurboJpegArenaBlock *block = BLOCK_HEADER (data);
+
+  arena->allocated -= block->size;
+  g_free (block->raw);
+}
+
+GstTurboJpegArena *
+gst_turbojpeg_arena_new (void)
+{
+  GstTurboJpegArena *arena = g_new0 (GstTurboJpegArena, 1);
+
+  g_mutex_init (&arena->lock);
+
+  return arena;
+}
+
+void
+gst_turbojpeg_arena_free (GstTurboJpegArena * arena)
+{
+  gst_turbojpeg_arena_reset (arena);
+  g_mutex_clear (&arena->lock);
+  g_free (arena);
+}
+
+/* Drop the cached blocks, e.g. after a resolution or subsampling change.
+ * Blocks still in use are freed when they are released */
+void
+gst_turbojpeg_arena_reset (GstTurboJpegArena * arena)
+{
+  GSList *l;
+
+  g_mutex_lock (&arena->lock);
+  for (l = arena->free_blocks; l; l = l->next)
+    gst_turbojpeg_arena_free_block (arena, l->data);
+  g_slist_free (arena->free_blocks);
+  arena->free_blocks = NULL;
+  arena->generation++;
+  g_mutex_unlock (&arena->lock);
+}
+
+/* Allocate a block of @size up front so the first frame does not */
+void
+gst_turbojpeg_arena_reserve (GstTurboJpegArena * arena, gsize size)
+{
+  g_mutex_lock (&arena->lock);
+  arena->free_blocks = g_slist_prepend (arena->free_blocks,
+      gst_turbojpeg_arena_alloc_block (arena, size));
+  g_mutex_unlock (&arena->lock);
+}
+
+gpointer
+gst_turbojpeg_arena_acquire (GstTurboJpegArena * arena, gsize size)
+{
+  gpointer data = NULL;
+  GSList *l;
+
+  g_mutex_lock (&arena->lock);
+  for (l = arena->free_blocks; l; l = l->next) {
+    if (BLOCK_HEADER (l->data)->size == size) {
+      data = l->data;
+      arena->free_blocks = g_slist_delete_link (arena->free_blocks, l);
+      break;
+    }
+  }
+  if (!data)
+    data = gst_turbojpeg_arena_alloc_block (arena, size);
+  g_mutex_unlock (&arena->lock);
+
+  return data;
+}
+
+void
+gst_turbojpeg_arena_release (GstTurboJpegArena * arena, gpointer data)
+{
+  g_mutex_lock (&arena->lock);
+  if (BLOCK_HEADER (data)->generation == arena->generation)
+    arena->free_blocks = g_slist_prepend (arena->free_blocks, data);
+  else
+    gst_turbojpeg_arena_free_block (arena, data);
+  g_mutex_unlock (&arena->lock);
+}
+
+/* Largest number of bytes the arena has held at once */
+guint64
+gst_turbojpeg_arena_get_high_water (GstTurboJpegArena * arena)
+{
+  guint64 high_water;
+
+  g_mutex_lock (&arena->lock);
+  high_water = arena->high_water;
+  g_mutex_unlock (&arena->lock);
+
+  return high_water;
+}
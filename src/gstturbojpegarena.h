@@ -0,0 +1,45 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_ARENA_H__
+#define __GST_TURBOJPEG_ARENA_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Alignment of every block, a cache line and the widest SIMD register */
+#define GST_TURBOJPEG_ARENA_ALIGN 64
+
+typedef struct _GstTurboJpegArena GstTurboJpegArena;
+
+GstTurboJpegArena *gst_turbojpeg_arena_new (void);
+void gst_turbojpeg_arena_free (GstTurboJpegArena * arena);
+
+void gst_turbojpeg_arena_reset (GstTurboJpegArena * arena);
+void gst_turbojpeg_arena_reserve (GstTurboJpegArena * arena, gsize size);
+
+gpointer gst_turbojpeg_arena_acquire (GstTurboJpegArena * arena, gsize size);
+void gst_turbojpeg_arena_release (GstTurboJpegArena * arena, gpointer data);
+
+guint64 gst_turbojpeg_arena_get_high_water (GstTurboJpegArena * arena);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_ARENA_H__ */
@@ -0,0 +1,318 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <string.h>
+
+#include "gstturbojpegblockmap.h"
+#include "gstturbojpegmeta.h"
+#include "gstturbojpegscan.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_turbojpeg_block_map_debug);
+#define GST_CAT_DEFAULT gst_turbojpeg_block_map_debug
+
+enum
+{
+  PROP_0,
+  PROP_AC_ENERGY
+};
+
+#define DEFAULT_AC_ENERGY FALSE
+
+/* SOF markers of lossless JPEGs, which have no DCT coefficients */
+#define IS_LOSSLESS_SOF(m) ((m) == 0xC3 || (m) == 0xC7 || (m) == 0xCB || \
+    (m) == 0xCF)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg")
+    );
+
+/* State handed to the coefficient filter of one frame */
+typedef struct
+{
+  GstTurboJpegBlockMeta *meta;
+  const guint16 *quant;       /* Luma quantisation table, natural order */
+  gint precision;
+} GstTurboJpegBlockMapFilter;
+
+#define gst_turbojpeg_block_map_parent_class parent_class
+G_DEFINE_TYPE (GstTurboJpegBlockMap, gst_turbojpeg_block_map,
+    GST_TYPE_BASE_TRANSFORM);
+
+gboolean
+gst_turbojpeg_block_map_register (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, "turbojpegblockmap", GST_RANK_NONE,
+      GST_TYPE_TURBOJPEG_BLOCK_MAP);
+}
+
+static void gst_turbojpeg_block_map_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_turbojpeg_block_map_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_turbojpeg_block_map_start (GstBaseTransform * trans);
+static gboolean gst_turbojpeg_block_map_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_turbojpeg_block_map_transform_ip (GstBaseTransform *
+    trans, GstBuffer * buf);
+
+static void
+gst_turbojpeg_block_map_class_init (GstTurboJpegBlockMapClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+  GstBaseTransformClass *trans_class;
+
+  gobject_class = (GObjectClass *) klass;
+  element_class = (GstElementClass *) klass;
+  trans_class = (GstBaseTransformClass *) klass;
+
+  gobject_class->set_property = gst_turbojpeg_block_map_set_property;
+  gobject_class->get_property = gst_turbojpeg_block_map_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_AC_ENERGY,
+      g_param_spec_boolean ("ac-energy", "AC energy",
+          "Also record the sum of the absolute dequantised AC coefficients "
+          "of every luma block, a measure of its detail",
+          DEFAULT_AC_ENERGY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "TurboJPEG Block Map", "Filter/Analyzer/Video",
+      "Attach a 1/8-scale luma map read from the DCT coefficients of JPEG "
+      "images, passing the JPEG through undecoded",
+      "GStreamer TurboJPEG Plugin");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_turbojpeg_block_map_start);
+  trans_class->stop = GST_DEBUG_FUNCPTR (gst_turbojpeg_block_map_stop);
+  trans_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_turbojpeg_block_map_transform_ip);
+
+  GST_DEBUG_CATEGORY_INIT (gst_turbojpeg_block_map_debug, "turbojpegblockmap",
+      0, "TurboJPEG block map");
+}
+
+static void
+gst_turbojpeg_block_map_init (GstTurboJpegBlockMap * map)
+{
+  map->tjInstance = NULL;
+  map->ac_energy = DEFAULT_AC_ENERGY;
+
+  /* Only metas are added, the JPEG itself is never touched */
+  gst_base_transform_set_in_place (GST_BASE_TRANSFORM (map), TRUE);
+}
+
+static void
+gst_turbojpeg_block_map_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstTurboJpegBlockMap *map = GST_TURBOJPEG_BLOCK_MAP (object);
+
+  switch (prop_id) {
+    case PROP_AC_ENERGY:
+      GST_OBJECT_LOCK (map);
+      map->ac_energy = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (map);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_turbojpeg_block_map_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstTurboJpegBlockMap *map = GST_TURBOJPEG_BLOCK_MAP (object);
+
+  switch (prop_id) {
+    case PROP_AC_ENERGY:
+      GST_OBJECT_LOCK (map);
+      g_value_set_boolean (value, map->ac_energy);
+      GST_OBJECT_UNLOCK (map);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static gboolean
+gst_turbojpeg_block_map_start (GstBaseTransform * trans)
+{
+  GstTurboJpegBlockMap *map = GST_TURBOJPEG_BLOCK_MAP (trans);
+
+  map->tjInstance = tj3Init (TJINIT_TRANSFORM);
+  if (!map->tjInstance) {
+    GST_ERROR_OBJECT (map, "Failed to initialize TurboJPEG transform "
+        "instance");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_turbojpeg_block_map_stop (GstBaseTransform * trans)
+{
+  GstTurboJpegBlockMap *map = GST_TURBOJPEG_BLOCK_MAP (trans);
+
+  if (map->tjInstance) {
+    tj3Destroy (map->tjInstance);
+    map->tjInstance = NULL;
+  }
+
+  return TRUE;
+}
+
+/* Called by tj3Transform() with the quantised coefficients of one row of
+ * blocks at a time, blocks stored one after the other in natural order */
+static int
+gst_turbojpeg_block_map_filter (short *coeffs, tjregion array_region,
+    tjregion plane_region, int component, int transform_id,
+    tjtransform * transform)
+{
+  GstTurboJpegBlockMapFilter *filter = transform->data;
+  GstTurboJpegBlockMeta *meta = filter->meta;
+  const guint16 *quant = filter->quant;
+  gint center = 1 << (filter->precision - 1);
+  gint shift = filter->precision - 8;
+  gint row_blocks = array_region.w / 8;
+  gint n_cols = MIN (row_blocks, (gint) meta->width);
+  gint r, bx, k;
+
+  if (component != 0)
+    return 0;
+
+  for (r = 0; r < array_region.h / 8; r++) {
+    gint by = array_region.y / 8 + r;
+    const short *block = coeffs + (gsize) r * row_blocks * 64;
+    guint8 *dc;
+
+    if (by >= (gint) meta->height)
+      break;
+    dc = meta->dc + (gsize) by * meta->width;
+
+    for (bx = 0; bx < n_cols; bx++, block += 64) {
+      /* The DC term is eight times the mean of the level-shifted block */
+      gint mean = ((block[0] * quant[0]) / 8 + center) >> shift;
+
+      dc[bx] = CLAMP (mean, 0, 255);
+
+      if (meta->ac_energy) {
+        guint32 energy = 0;
+
+        for (k = 1; k < 64; k++)
+          energy += ABS (block[k]) * quant[k];
+        meta->ac_energy[(gsize) by * meta->width + bx] = energy;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static GstFlowReturn
+gst_turbojpeg_block_map_transform_ip (GstBaseTransform * trans,
+    GstBuffer * buf)
+{
+  GstTurboJpegBlockMap *map = GST_TURBOJPEG_BLOCK_MAP (trans);
+  GstTurboJpegBlockMapFilter filter;
+  GstTurboJpegScanInfo info;
+  GstTurboJpegBlockMeta *meta;
+  GstMapInfo map_info;
+  tjtransform xform;
+  guchar *dst = NULL;
+  size_t dst_size = 0;
+  gint luma_width, luma_height;
+  gboolean ac_energy;
+
+  GST_OBJECT_LOCK (map);
+  ac_energy = map->ac_energy;
+  GST_OBJECT_UNLOCK (map);
+
+  if (!gst_buffer_map (buf, &map_info, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (map, "Failed to map input buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  /* Frames the map cannot be read from pass through without a meta */
+  if (!gst_turbojpeg_scan_headers (map_info.data, map_info.size, &info) ||
+      info.precision < 8 || info.precision > 12) {
+    GST_WARNING_OBJECT (map, "Unsupported or corrupt JPEG headers");
+    goto done;
+  }
+  if (IS_LOSSLESS_SOF (info.sof_marker)) {
+    GST_LOG_OBJECT (map, "Lossless JPEG has no DCT coefficients");
+    goto done;
+  }
+  if (!(info.quant_tables & (1 << info.quant_index[0]))) {
+    GST_WARNING_OBJECT (map, "Missing luma quantisation table");
+    goto done;
+  }
+
+  luma_width = (info.width * info.h_samp[0] + info.max_h_samp - 1) /
+      info.max_h_samp;
+  luma_height = (info.height * info.v_samp[0] + info.max_v_samp - 1) /
+      info.max_v_samp;
+
+  meta = gst_buffer_add_turbojpeg_block_meta (buf, (luma_width + 7) / 8,
+      (luma_height + 7) / 8, ac_energy);
+  meta->block_size = 8 * info.max_h_samp / info.h_samp[0];
+
+  filter.meta = meta;
+  filter.quant = info.quant[info.quant_index[0]];
+  filter.precision = info.precision;
+
+  /* Entropy decoding only: no IDCT, colour conversion or output JPEG */
+  memset (&xform, 0, sizeof (xform));
+  xform.op = TJXOP_NONE;
+  xform.options = TJXOPT_NOOUTPUT;
+  xform.data = &filter;
+  xform.customFilter = gst_turbojpeg_block_map_filter;
+
+  if (tj3Transform (map->tjInstance, map_info.data, map_info.size, 1, &dst,
+          &dst_size, &xform) < 0) {
+    GST_WARNING_OBJECT (map, "Failed to read DCT coefficients: %s",
+        tj3GetErrorStr (map->tjInstance));
+    gst_buffer_remove_meta (buf, (GstMeta *) meta);
+  }
+  tj3Free (dst);
+
+done:
+  gst_buffer_unmap (buf, &map_info);
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,62 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_BLOCK_MAP_H__
+#define __GST_TURBOJPEG_BLOCK_MAP_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <turbojpeg.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_TURBOJPEG_BLOCK_MAP \
+  (gst_turbojpeg_block_map_get_type())
+#define GST_TURBOJPEG_BLOCK_MAP(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_TURBOJPEG_BLOCK_MAP,GstTurboJpegBlockMap))
+#define GST_TURBOJPEG_BLOCK_MAP_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_TURBOJPEG_BLOCK_MAP,GstTurboJpegBlockMapClass))
+#define GST_IS_TURBOJPEG_BLOCK_MAP(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_TURBOJPEG_BLOCK_MAP))
+#define GST_IS_TURBOJPEG_BLOCK_MAP_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_TURBOJPEG_BLOCK_MAP))
+
+typedef struct _GstTurboJpegBlockMap GstTurboJpegBlockMap;
+typedef struct _GstTurboJpegBlockMapClass GstTurboJpegBlockMapClass;
+
+struct _GstTurboJpegBlockMap
+{
+  GstBaseTransform parent;
+
+  tjhandle tjInstance;        /* Transform instance reading coefficients */
+
+  gboolean ac_energy;
+};
+
+struct _GstTurboJpegBlockMapClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_turbojpeg_block_map_get_type (void);
+gboolean gst_turbojpeg_block_map_register (GstPlugin * plugin);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_BLOCK_MAP_H__ */
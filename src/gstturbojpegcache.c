@@ -0,0 +1,215 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstturbojpegcache.h"
+
+typedef struct
+{
+  GstTurboJpegCacheKey key;
+  GstBuffer *buffer;          /* Read-only, never handed out writable */
+  gsize bytes;
+  GList link;                 /* Position in the recency list */
+} GstTurboJpegCacheEntry;
+
+/* A thread-safe LRU of decoded frames bounded by a byte budget. The most
+ * recently used entry heads the recency list, evictions take its tail */
+struct _GstTurboJpegCache
+{
+  GMutex lock;
+  GHashTable *entries;        /* GstTurboJpegCacheKey -> entry */
+  GQueue lru;
+  guint64 budget;             /* 0 disables the cache */
+  guint64 bytes;
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+};
+
+static guint
+gst_turbojpeg_cache_key_hash (gconstpointer data)
+{
+  const GstTurboJpegCacheKey *key = data;
+
+  return (guint) (key->hash ^ (key->hash >> 32) ^ key->variant);
+}
+
+static gboolean
+gst_turbojpeg_cache_key_equal (gconstpointer a, gconstpointer b)
+{
+  const GstTurboJpegCacheKey *ka = a, *kb = b;
+
+  return ka->hash == kb->hash && ka->size == kb->size &&
+      ka->variant == kb->variant;
+}
+
+static void
+gst_turbojpeg_cache_entry_free (gpointer data)
+{
+  GstTurboJpegCacheEntry *entry = data;
+
+  gst_buffer_unref (entry->buffer);
+  g_slice_free (GstTurboJpegCacheEntry, entry);
+}
+
+GstTurboJpegCache *
+gst_turbojpeg_cache_new (void)
+{
+  GstTurboJpegCache *cache = g_new0 (GstTurboJpegCache, 1);
+
+  g_mutex_init (&cache->lock);
+  cache->entries = g_hash_table_new_full (gst_turbojpeg_cache_key_hash,
+      gst_turbojpeg_cache_key_equal, NULL, gst_turbojpeg_cache_entry_free);
+  g_queue_init (&cache->lru);
+
+  return cache;
+}
+
+void
+gst_turbojpeg_cache_free (GstTurboJpegCache * cache)
+{
+  g_hash_table_destroy (cache->entries);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+static void
+gst_turbojpeg_cache_remove (GstTurboJpegCache * cache,
+    GstTurboJpegCacheEntry * entry)
+{
+  g_queue_unlink (&cache->lru, &entry->link);
+  cache->bytes -= entry->bytes;
+  g_hash_table_remove (cache->entries, &entry->key);
+}
+
+/* Evict least recently used entries until @bytes more fit the budget */
+static void
+gst_turbojpeg_cache_make_room (GstTurboJpegCache * cache, guint64 bytes)
+{
+  while (cache->lru.tail && cache->bytes + bytes > cache->budget) {
+    gst_turbojpeg_cache_remove (cache, cache->lru.tail->data);
+    cache->evictions++;
+  }
+}
+
+/* Drop every entry, e.g. when the stream stops. The statistics are kept */
+void
+gst_turbojpeg_cache_clear (GstTurboJpegCache * cache)
+{
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove_all (cache->entries);
+  g_queue_init (&cache->lru);
+  cache->bytes = 0;
+  g_mutex_unlock (&cache->lock);
+}
+
+void
+gst_turbojpeg_cache_set_budget (GstTurboJpegCache * cache, guint64 budget)
+{
+  g_mutex_lock (&cache->lock);
+  cache->budget = budget;
+  gst_turbojpeg_cache_make_room (cache, 0);
+  g_mutex_unlock (&cache->lock);
+}
+
+guint64
+gst_turbojpeg_cache_get_budget (GstTurboJpegCache * cache)
+{
+  guint64 budget;
+
+  g_mutex_lock (&cache->lock);
+  budget = cache->budget;
+  g_mutex_unlock (&cache->lock);
+
+  return budget;
+}
+
+/* Returns a new reference to the frame decoded for @key, or NULL. Lookups
+ * made while the cache is disabled are not counted */
+GstBuffer *
+gst_turbojpeg_cache_lookup (GstTurboJpegCache * cache,
+    const GstTurboJpegCacheKey * key)
+{
+  GstTurboJpegCacheEntry *entry;
+  GstBuffer *buffer = NULL;
+
+  g_mutex_lock (&cache->lock);
+  if (cache->budget > 0) {
+    entry = g_hash_table_lookup (cache->entries, key);
+    if (entry) {
+      g_queue_unlink (&cache->lru, &entry->link);
+      g_queue_push_head_link (&cache->lru, &entry->link);
+      buffer = gst_buffer_ref (entry->buffer);
+      cache->hits++;
+    } else {
+      cache->misses++;
+    }
+  }
+  g_mutex_unlock (&cache->lock);
+
+  return buffer;
+}
+
+/* Store a decoded frame. Buffers from a pool are copied so the cache never
+ * keeps pool buffers from being recycled; others are shared, which leaves
+ * them read-only for everyone */
+void
+gst_turbojpeg_cache_insert (GstTurboJpegCache * cache,
+    const GstTurboJpegCacheKey * key, GstBuffer * buffer)
+{
+  GstTurboJpegCacheEntry *entry;
+  gsize bytes = gst_buffer_get_size (buffer);
+
+  g_mutex_lock (&cache->lock);
+  if (bytes > cache->budget ||
+      g_hash_table_contains (cache->entries, key)) {
+    g_mutex_unlock (&cache->lock);
+    return;
+  }
+
+  gst_turbojpeg_cache_make_room (cache, bytes);
+
+  entry = g_slice_new0 (GstTurboJpegCacheEntry);
+  entry->key = *key;
+  entry->bytes = bytes;
+  entry->link.data = entry;
+  if (buffer->pool)
+    entry->buffer = gst_buffer_copy_deep (buffer);
+  else
+    entry->buffer = gst_buffer_ref (buffer);
+
+  g_hash_table_insert (cache->entries, &entry->key, entry);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  cache->bytes += bytes;
+  g_mutex_unlock (&cache->lock);
+}
+
+void
+gst_turbojpeg_cache_get_stats (GstTurboJpegCache * cache, guint64 * hits,
+    guint64 * misses, guint64 * evictions)
+{
+  g_mutex_lock (&cache->lock);
+  *hits = cache->hits;
+  *misses = cache->misses;
+  *evictions = cache->evictions;
+  g_mutex_unlock (&cache->lock);
+}
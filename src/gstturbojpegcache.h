@@ -0,0 +1,56 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_CACHE_H__
+#define __GST_TURBOJPEG_CACHE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Identifies a decoded frame: the compressed bytes and the output
+ * configuration they were decoded for */
+typedef struct
+{
+  guint64 hash;               /* gst_turbojpeg_hash() of the JPEG */
+  gsize size;                 /* Size of the JPEG */
+  guint64 variant;            /* Hash of the output format, size and scale */
+} GstTurboJpegCacheKey;
+
+typedef struct _GstTurboJpegCache GstTurboJpegCache;
+
+GstTurboJpegCache *gst_turbojpeg_cache_new (void);
+void gst_turbojpeg_cache_free (GstTurboJpegCache * cache);
+
+void gst_turbojpeg_cache_clear (GstTurboJpegCache * cache);
+void gst_turbojpeg_cache_set_budget (GstTurboJpegCache * cache,
+    guint64 budget);
+guint64 gst_turbojpeg_cache_get_budget (GstTurboJpegCache * cache);
+
+GstBuffer *gst_turbojpeg_cache_lookup (GstTurboJpegCache * cache,
+    const GstTurboJpegCacheKey * key);
+void gst_turbojpeg_cache_insert (GstTurboJpegCache * cache,
+    const GstTurboJpegCacheKey * key, GstBuffer * buffer);
+
+void gst_turbojpeg_cache_get_stats (GstTurboJpegCache * cache,
+    guint64 * hits, guint64 * misses, guint64 * evictions);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_CACHE_H__ */
@@ -0,0 +1,721 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstturbojpegconvert.h"
+
+/* The plugin is built with -march=native, so the widest instruction set
+ * the compiler enables is used. Every kernel runs its vector loops first
+ * and finishes the row edges and tails with the scalar code */
+#if defined (__AVX2__)
+#define HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined (__SSE2__)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined (__SSSE3__)
+#define HAVE_SSSE3 1
+#include <tmmintrin.h>
+#endif
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* dst[x] = box average of src[2x], src[2x + 1] */
+static void
+gst_turbojpeg_h_down2 (guint8 * dst, const guint8 * src, gint dst_w,
+    gint src_w)
+{
+  gint x = 0;
+
+#if defined (HAVE_AVX2)
+  {
+    const __m256i mask = _mm256_set1_epi16 (0x00FF);
+
+    for (; x + 32 <= dst_w && 2 * x + 64 <= src_w; x += 32) {
+      __m256i lo = _mm256_loadu_si256 ((const __m256i *) (src + 2 * x));
+      __m256i hi = _mm256_loadu_si256 ((const __m256i *) (src + 2 * x + 32));
+      __m256i even = _mm256_packus_epi16 (_mm256_and_si256 (lo, mask),
+          _mm256_and_si256 (hi, mask));
+      __m256i odd = _mm256_packus_epi16 (_mm256_srli_epi16 (lo, 8),
+          _mm256_srli_epi16 (hi, 8));
+      /* packus works per 128-bit lane, restore the quadword order */
+      _mm256_storeu_si256 ((__m256i *) (dst + x),
+          _mm256_permute4x64_epi64 (_mm256_avg_epu8 (even, odd), 0xD8));
+    }
+  }
+#endif
+#if defined (HAVE_SSE2)
+  {
+    const __m128i mask = _mm_set1_epi16 (0x00FF);
+
+    for (; x + 16 <= dst_w && 2 * x + 32 <= src_w; x += 16) {
+      __m128i lo = _mm_loadu_si128 ((const __m128i *) (src + 2 * x));
+      __m128i hi = _mm_loadu_si128 ((const __m128i *) (src + 2 * x + 16));
+      __m128i even = _mm_packus_epi16 (_mm_and_si128 (lo, mask),
+          _mm_and_si128 (hi, mask));
+      __m128i odd = _mm_packus_epi16 (_mm_srli_epi16 (lo, 8),
+          _mm_srli_epi16 (hi, 8));
+      _mm_storeu_si128 ((__m128i *) (dst + x), _mm_avg_epu8 (even, odd));
+    }
+  }
+#elif defined (HAVE_NEON)
+  for (; x + 16 <= dst_w && 2 * x + 32 <= src_w; x += 16) {
+    uint8x16x2_t v = vld2q_u8 (src + 2 * x);
+    vst1q_u8 (dst + x, vrhaddq_u8 (v.val[0], v.val[1]));
+  }
+#endif
+
+  for (; x < dst_w; x++) {
+    gint a = src[MIN (2 * x, src_w - 1)];
+    gint b = src[MIN (2 * x + 1, src_w - 1)];
+    dst[x] = (a + b + 1) >> 1;
+  }
+}
+
+/* dst[2x], dst[2x + 1] = 3/4 src[x] + 1/4 of the left/right neighbour,
+ * the same triangle filter libjpeg uses for fancy upsampling */
+static void
+gst_turbojpeg_h_up2 (guint8 * dst, const guint8 * src, gint dst_w,
+    gint src_w)
+{
+  gint x = 0, i = 1;
+
+  /* The first output pair needs the clamped left edge */
+  if (dst_w > 2 && src_w > 1) {
+    dst[0] = (3 * src[0] + src[0] + 2) >> 2;
+    dst[1] = (3 * src[0] + src[1] + 2) >> 2;
+
+#if defined (HAVE_SSE2)
+    {
+      const __m128i zero = _mm_setzero_si128 ();
+      const __m128i two = _mm_set1_epi16 (2);
+
+      for (; i + 9 <= src_w && 2 * i + 16 <= dst_w; i += 8) {
+        __m128i c = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)
+                (src + i)), zero);
+        __m128i p = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)
+                (src + i - 1)), zero);
+        __m128i n = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *)
+                (src + i + 1)), zero);
+        __m128i c3 = _mm_add_epi16 (_mm_add_epi16 (c, c), _mm_add_epi16 (c,
+                two));
+        __m128i e = _mm_srli_epi16 (_mm_add_epi16 (c3, p), 2);
+        __m128i o = _mm_srli_epi16 (_mm_add_epi16 (c3, n), 2);
+
+        _mm_storeu_si128 ((__m128i *) (dst + 2 * i),
+            _mm_unpacklo_epi8 (_mm_packus_epi16 (e, e),
+                _mm_packus_epi16 (o, o)));
+      }
+    }
+#elif defined (HAVE_NEON)
+    {
+      const uint8x8_t three = vdup_n_u8 (3);
+
+      for (; i + 9 <= src_w && 2 * i + 16 <= dst_w; i += 8) {
+        uint16x8_t c3 = vmull_u8 (vld1_u8 (src + i), three);
+        uint8x8x2_t out;
+
+        out.val[0] = vrshrn_n_u16 (vaddw_u8 (c3, vld1_u8 (src + i - 1)), 2);
+        out.val[1] = vrshrn_n_u16 (vaddw_u8 (c3, vld1_u8 (src + i + 1)), 2);
+        vst2_u8 (dst + 2 * i, out);
+      }
+    }
+#endif
+    x = 2 * i;
+  }
+
+  for (; x < dst_w; x++) {
+    gint c = MIN (x >> 1, src_w - 1);
+    gint n = (x & 1) ? MIN (c + 1, src_w - 1) : MAX (c - 1, 0);
+    dst[x] = (3 * src[c] + src[n] + 2) >> 2;
+  }
+}
+
+/* Four outputs per input at offsets -3/8, -1/8, +1/8 and +3/8. Only used
+ * for 4:1:1 sources, which are rare enough to leave to the compiler */
+static void
+gst_turbojpeg_h_up4 (guint8 * dst, const guint8 * src, gint dst_w,
+    gint src_w)
+{
+  static const gint near_weight[4] = { 5, 7, 7, 5 };
+  gint x;
+
+  for (x = 0; x < dst_w; x++) {
+    gint c = MIN (x >> 2, src_w - 1);
+    gint p = x & 3;
+    gint n = p < 2 ? MAX (c - 1, 0) : MIN (c + 1, src_w - 1);
+    dst[x] = (near_weight[p] * src[c] + (8 - near_weight[p]) * src[n] +
+        4) >> 3;
+  }
+}
+
+/* dst[x] = box average of the 2x2 block at (2x, a) and (2x, b) */
+static void
+gst_turbojpeg_box2x2 (guint8 * dst, const guint8 * a, const guint8 * b,
+    gint dst_w, gint src_w)
+{
+  gint x = 0;
+
+#if defined (HAVE_AVX2)
+  {
+    const __m256i mask = _mm256_set1_epi16 (0x00FF);
+    const __m256i two = _mm256_set1_epi16 (2);
+
+    for (; x + 32 <= dst_w && 2 * x + 64 <= src_w; x += 32) {
+      __m256i a0 = _mm256_loadu_si256 ((const __m256i *) (a + 2 * x));
+      __m256i a1 = _mm256_loadu_si256 ((const __m256i *) (a + 2 * x + 32));
+      __m256i b0 = _mm256_loadu_si256 ((const __m256i *) (b + 2 * x));
+      __m256i b1 = _mm256_loadu_si256 ((const __m256i *) (b + 2 * x + 32));
+      __m256i s0 = _mm256_add_epi16 (_mm256_add_epi16 (_mm256_and_si256 (a0,
+                  mask), _mm256_srli_epi16 (a0, 8)),
+          _mm256_add_epi16 (_mm256_and_si256 (b0, mask),
+              _mm256_srli_epi16 (b0, 8)));
+      __m256i s1 = _mm256_add_epi16 (_mm256_add_epi16 (_mm256_and_si256 (a1,
+                  mask), _mm256_srli_epi16 (a1, 8)),
+          _mm256_add_epi16 (_mm256_and_si256 (b1, mask),
+              _mm256_srli_epi16 (b1, 8)));
+
+      s0 = _mm256_srli_epi16 (_mm256_add_epi16 (s0, two), 2);
+      s1 = _mm256_srli_epi16 (_mm256_add_epi16 (s1, two), 2);
+      _mm256_storeu_si256 ((__m256i *) (dst + x),
+          _mm256_permute4x64_epi64 (_mm256_packus_epi16 (s0, s1), 0xD8));
+    }
+  }
+#endif
+#if defined (HAVE_SSE2)
+  {
+    const __m128i mask = _mm_set1_epi16 (0x00FF);
+    const __m128i two = _mm_set1_epi16 (2);
+
+    for (; x + 16 <= dst_w && 2 * x + 32 <= src_w; x += 16) {
+      __m128i a0 = _mm_loadu_si128 ((const __m128i *) (a + 2 * x));
+      __m128i a1 = _mm_loadu_si128 ((const __m128i *) (a + 2 * x + 16));
+      __m128i b0 = _mm_loadu_si128 ((const __m128i *) (b + 2 * x));
+      __m128i b1 = _mm_loadu_si128 ((const __m128i *) (b + 2 * x + 16));
+      __m128i s0 = _mm_add_epi16 (_mm_add_epi16 (_mm_and_si128 (a0, mask),
+              _mm_srli_epi16 (a0, 8)), _mm_add_epi16 (_mm_and_si128 (b0,
+                  mask), _mm_srli_epi16 (b0, 8)));
+      __m128i s1 = _mm_add_epi16 (_mm_add_epi16 (_mm_and_si128 (a1, mask),
+              _mm_srli_epi16 (a1, 8)), _mm_add_epi16 (_mm_and_si128 (b1,
+                  mask), _mm_srli_epi16 (b1, 8)));
+
+      s0 = _mm_srli_epi16 (_mm_add_epi16 (s0, two), 2);
+      s1 = _mm_srli_epi16 (_mm_add_epi16 (s1, two), 2);
+      _mm_storeu_si128 ((__m128i *) (dst + x), _mm_packus_epi16 (s0, s1));
+    }
+  }
+#elif defined (HAVE_NEON)
+  for (; x + 16 <= dst_w && 2 * x + 32 <= src_w; x += 16) {
+    uint16x8_t s0 = vpadalq_u8 (vpaddlq_u8 (vld1q_u8 (a + 2 * x)),
+        vld1q_u8 (b + 2 * x));
+    uint16x8_t s1 = vpadalq_u8 (vpaddlq_u8 (vld1q_u8 (a + 2 * x + 16)),
+        vld1q_u8 (b + 2 * x + 16));
+
+    vst1q_u8 (dst + x, vcombine_u8 (vrshrn_n_u16 (s0, 2),
+            vrshrn_n_u16 (s1, 2)));
+  }
+#endif
+
+  for (; x < dst_w; x++) {
+    gint x0 = MIN (2 * x, src_w - 1);
+    gint x1 = MIN (2 * x + 1, src_w - 1);
+    dst[x] = (a[x0] + a[x1] + b[x0] + b[x1] + 2) >> 2;
+  }
+}
+
+/* dst[x] = (wa * a[x] + wb * b[x]) / 2^shift, rounded; wa + wb == 2^shift */
+static void
+gst_turbojpeg_blend_rows (guint8 * dst, const guint8 * a, const guint8 * b,
+    gint n, gint wa, gint wb, gint shift)
+{
+  gint x = 0;
+
+  if (wa == 1 && wb == 1) {
+#if defined (HAVE_AVX2)
+    for (; x + 32 <= n; x += 32) {
+      _mm256_storeu_si256 ((__m256i *) (dst + x),
+          _mm256_avg_epu8 (_mm256_loadu_si256 ((const __m256i *) (a + x)),
+              _mm256_loadu_si256 ((const __m256i *) (b + x))));
+    }
+#endif
+#if defined (HAVE_SSE2)
+    for (; x + 16 <= n; x += 16) {
+      _mm_storeu_si128 ((__m128i *) (dst + x),
+          _mm_avg_epu8 (_mm_loadu_si128 ((const __m128i *) (a + x)),
+              _mm_loadu_si128 ((const __m128i *) (b + x))));
+    }
+#elif defined (HAVE_NEON)
+    for (; x + 16 <= n; x += 16)
+      vst1q_u8 (dst + x, vrhaddq_u8 (vld1q_u8 (a + x), vld1q_u8 (b + x)));
+#endif
+  } else {
+#if defined (HAVE_AVX2)
+    {
+      const __m256i va = _mm256_set1_epi16 (wa);
+      const __m256i vb = _mm256_set1_epi16 (wb);
+      const __m256i round = _mm256_set1_epi16 (1 << (shift - 1));
+      const __m128i sh = _mm_cvtsi32_si128 (shift);
+
+      for (; x + 32 <= n; x += 32) {
+        __m256i lo = _mm256_add_epi16 (_mm256_mullo_epi16 (_mm256_cvtepu8_epi16
+                (_mm_loadu_si128 ((const __m128i *) (a + x))), va),
+            _mm256_mullo_epi16 (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const
+                            __m128i *) (b + x))), vb));
+        __m256i hi = _mm256_add_epi16 (_mm256_mullo_epi16 (_mm256_cvtepu8_epi16
+                (_mm_loadu_si128 ((const __m128i *) (a + x + 16))), va),
+            _mm256_mullo_epi16 (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const
+                            __m128i *) (b + x + 16))), vb));
+
+        lo = _mm256_srl_epi16 (_mm256_add_epi16 (lo, round), sh);
+        hi = _mm256_srl_epi16 (_mm256_add_epi16 (hi, round), sh);
+        _mm256_storeu_si256 ((__m256i *) (dst + x),
+            _mm256_permute4x64_epi64 (_mm256_packus_epi16 (lo, hi), 0xD8));
+      }
+    }
+#endif
+#if defined (HAVE_SSE2)
+    {
+      const __m128i zero = _mm_setzero_si128 ();
+      const __m128i va = _mm_set1_epi16 (wa);
+      const __m128i vb = _mm_set1_epi16 (wb);
+      const __m128i round = _mm_set1_epi16 (1 << (shift - 1));
+      const __m128i sh = _mm_cvtsi32_si128 (shift);
+
+      for (; x + 16 <= n; x += 16) {
+        __m128i a8 = _mm_loadu_si128 ((const __m128i *) (a + x));
+        __m128i b8 = _mm_loadu_si128 ((const __m128i *) (b + x));
+        __m128i lo = _mm_add_epi16 (_mm_mullo_epi16 (_mm_unpacklo_epi8 (a8,
+                    zero), va), _mm_mullo_epi16 (_mm_unpacklo_epi8 (b8, zero),
+                vb));
+        __m128i hi = _mm_add_epi16 (_mm_mullo_epi16 (_mm_unpackhi_epi8 (a8,
+                    zero), va), _mm_mullo_epi16 (_mm_unpackhi_epi8 (b8, zero),
+                vb));
+
+        lo = _mm_srl_epi16 (_mm_add_epi16 (lo, round), sh);
+        hi = _mm_srl_epi16 (_mm_add_epi16 (hi, round), sh);
+        _mm_storeu_si128 ((__m128i *) (dst + x), _mm_packus_epi16 (lo, hi));
+      }
+    }
+#elif defined (HAVE_NEON)
+    {
+      const uint8x8_t va = vdup_n_u8 (wa);
+      const uint8x8_t vb = vdup_n_u8 (wb);
+      const int16x8_t sh = vdupq_n_s16 (-shift);
+
+      for (; x + 8 <= n; x += 8) {
+        uint16x8_t acc = vmlal_u8 (vmull_u8 (vld1_u8 (a + x), va),
+            vld1_u8 (b + x), vb);
+        vst1_u8 (dst + x, vmovn_u16 (vrshlq_u16 (acc, sh)));
+      }
+    }
+#endif
+  }
+
+  for (; x < n; x++)
+    dst[x] = (wa * a[x] + wb * b[x] + (1 << (shift - 1))) >> shift;
+}
+
+static gboolean
+gst_turbojpeg_resample_op (gint src_factor, gint dst_factor,
+    GstTurboJpegResampleOp * op)
+{
+  if (src_factor == dst_factor)
+    *op = GST_TURBOJPEG_RESAMPLE_COPY;
+  else if (dst_factor == 2 * src_factor)
+    *op = GST_TURBOJPEG_RESAMPLE_DOWN2;
+  else if (src_factor == 2 * dst_factor)
+    *op = GST_TURBOJPEG_RESAMPLE_UP2;
+  else if (src_factor == 4 * dst_factor)
+    *op = GST_TURBOJPEG_RESAMPLE_UP4;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Resolve the kernels converting a chroma plane subsampled by
+ * src_h_factor x src_v_factor into one subsampled by dst_h_factor x
+ * dst_v_factor. Covers every JPEG sampling (4:4:4, 4:2:2, 4:4:0, 4:2:0,
+ * 4:1:1, 4:4:1) into 4:4:4, 4:2:2 and 4:2:0 planes */
+gboolean
+gst_turbojpeg_chroma_plan_init (GstTurboJpegChromaPlan * plan,
+    gint src_h_factor, gint src_v_factor, gint dst_h_factor,
+    gint dst_v_factor)
+{
+  memset (plan, 0, sizeof (*plan));
+
+  if (!gst_turbojpeg_resample_op (src_h_factor, dst_h_factor, &plan->h_op) ||
+      !gst_turbojpeg_resample_op (src_v_factor, dst_v_factor, &plan->v_op))
+    return FALSE;
+
+  switch (plan->h_op) {
+    case GST_TURBOJPEG_RESAMPLE_DOWN2:
+      plan->h_row = gst_turbojpeg_h_down2;
+      break;
+    case GST_TURBOJPEG_RESAMPLE_UP2:
+      plan->h_row = gst_turbojpeg_h_up2;
+      break;
+    case GST_TURBOJPEG_RESAMPLE_UP4:
+      plan->h_row = gst_turbojpeg_h_up4;
+      break;
+    default:
+      break;
+  }
+
+  if (plan->h_op == GST_TURBOJPEG_RESAMPLE_DOWN2 &&
+      plan->v_op == GST_TURBOJPEG_RESAMPLE_DOWN2)
+    plan->box_row = gst_turbojpeg_box2x2;
+
+  plan->blend_row = gst_turbojpeg_blend_rows;
+
+  return TRUE;
+}
+
+/* Scratch needed by gst_turbojpeg_chroma_resample() for two cached rows */
+gsize
+gst_turbojpeg_chroma_scratch_size (gint dst_w)
+{
+  return 2 * (gsize) dst_w;
+}
+
+typedef struct
+{
+  const GstTurboJpegChromaPlan *plan;
+  const guint8 *src;
+  gint src_stride;
+  gint src_w;
+  guint8 *rows[2];
+  gint index[2];
+  gint next;
+  gint dst_w;
+} GstTurboJpegRowCache;
+
+/* Source row @i after horizontal resampling. Vertical upsampling reads
+ * every source row twice, so the last two results are kept */
+static const guint8 *
+gst_turbojpeg_hrow (GstTurboJpegRowCache * cache, gint i)
+{
+  const guint8 *src = cache->src + (gsize) i * cache->src_stride;
+  gint slot;
+
+  if (!cache->plan->h_row)
+    return src;
+
+  if (cache->index[0] == i)
+    return cache->rows[0];
+  if (cache->index[1] == i)
+    return cache->rows[1];
+
+  slot = cache->next;
+  cache->next ^= 1;
+  cache->index[slot] = i;
+  cache->plan->h_row (cache->rows[slot], src, cache->dst_w, cache->src_w);
+
+  return cache->rows[slot];
+}
+
+/* Rows @dst_y to @dst_y + @n_rows of the resampled plane, written from the
+ * top of @dst. Rows outside the strip are read from @src as needed, so
+ * consecutive strips join up exactly */
+void
+gst_turbojpeg_chroma_resample_rows (const GstTurboJpegChromaPlan * plan,
+    const guint8 * src, gint src_stride, gint src_w, gint src_h,
+    guint8 * dst, gint dst_stride, gint dst_w, gint dst_y, gint n_rows,
+    guint8 * scratch)
+{
+  static const gint up4_near_weight[4] = { 5, 7, 7, 5 };
+  GstTurboJpegRowCache cache;
+  gint y;
+
+  cache.plan = plan;
+  cache.src = src;
+  cache.src_stride = src_stride;
+  cache.src_w = src_w;
+  cache.rows[0] = scratch;
+  cache.rows[1] = scratch + dst_w;
+  cache.index[0] = cache.index[1] = -1;
+  cache.next = 0;
+  cache.dst_w = dst_w;
+
+  for (y = dst_y; y < dst_y + n_rows; y++) {
+    guint8 *out = dst + (gsize) (y - dst_y) * dst_stride;
+    gint c, n, p;
+
+    switch (plan->v_op) {
+      case GST_TURBOJPEG_RESAMPLE_COPY:
+        c = MIN (y, src_h - 1);
+        if (plan->h_row)
+          plan->h_row (out, src + (gsize) c * src_stride, dst_w, src_w);
+        else
+          memcpy (out, src + (gsize) c * src_stride, dst_w);
+        break;
+      case GST_TURBOJPEG_RESAMPLE_DOWN2:
+        c = MIN (2 * y, src_h - 1);
+        n = MIN (2 * y + 1, src_h - 1);
+        if (plan->box_row)
+          plan->box_row (out, src + (gsize) c * src_stride,
+              src + (gsize) n * src_stride, dst_w, src_w);
+        else
+          plan->blend_row (out, gst_turbojpeg_hrow (&cache, c),
+              gst_turbojpeg_hrow (&cache, n), dst_w, 1, 1, 1);
+        break;
+      case GST_TURBOJPEG_RESAMPLE_UP2:
+        c = MIN (y >> 1, src_h - 1);
+        n = (y & 1) ? MIN (c + 1, src_h - 1) : MAX (c - 1, 0);
+        plan->blend_row (out, gst_turbojpeg_hrow (&cache, c),
+            gst_turbojpeg_hrow (&cache, n), dst_w, 3, 1, 2);
+        break;
+      case GST_TURBOJPEG_RESAMPLE_UP4:
+        c = MIN (y >> 2, src_h - 1);
+        p = y & 3;
+        n = p < 2 ? MAX (c - 1, 0) : MIN (c + 1, src_h - 1);
+        plan->blend_row (out, gst_turbojpeg_hrow (&cache, c),
+            gst_turbojpeg_hrow (&cache, n), dst_w, up4_near_weight[p],
+            8 - up4_near_weight[p], 3);
+        break;
+    }
+  }
+}
+
+void
+gst_turbojpeg_chroma_resample (const GstTurboJpegChromaPlan * plan,
+    const guint8 * src, gint src_stride, gint src_w, gint src_h,
+    guint8 * dst, gint dst_stride, gint dst_w, gint dst_h, guint8 * scratch)
+{
+  gst_turbojpeg_chroma_resample_rows (plan, src, src_stride, src_w, src_h,
+      dst, dst_stride, dst_w, 0, dst_h, scratch);
+}
+
+/* dst[2x] = a[x], dst[2x + 1] = b[x], the chroma row of a semi-planar
+ * (NV12/NV21) frame */
+void
+gst_turbojpeg_interleave_row (guint8 * dst, const guint8 * a,
+    const guint8 * b, gint n)
+{
+  gint x = 0;
+
+#if defined (HAVE_AVX2)
+  for (; x + 32 <= n; x += 32) {
+    __m256i va = _mm256_loadu_si256 ((const __m256i *) (a + x));
+    __m256i vb = _mm256_loadu_si256 ((const __m256i *) (b + x));
+    __m256i lo = _mm256_unpacklo_epi8 (va, vb);
+    __m256i hi = _mm256_unpackhi_epi8 (va, vb);
+    /* unpack works per 128-bit lane, put the halves back in order */
+    _mm256_storeu_si256 ((__m256i *) (dst + 2 * x),
+        _mm256_permute2x128_si256 (lo, hi, 0x20));
+    _mm256_storeu_si256 ((__m256i *) (dst + 2 * x + 32),
+        _mm256_permute2x128_si256 (lo, hi, 0x31));
+  }
+#endif
+#if defined (HAVE_SSE2)
+  for (; x + 16 <= n; x += 16) {
+    __m128i va = _mm_loadu_si128 ((const __m128i *) (a + x));
+    __m128i vb = _mm_loadu_si128 ((const __m128i *) (b + x));
+    _mm_storeu_si128 ((__m128i *) (dst + 2 * x), _mm_unpacklo_epi8 (va, vb));
+    _mm_storeu_si128 ((__m128i *) (dst + 2 * x + 16),
+        _mm_unpackhi_epi8 (va, vb));
+  }
+#elif defined (HAVE_NEON)
+  for (; x + 16 <= n; x += 16) {
+    uint8x16x2_t v;
+
+    v.val[0] = vld1q_u8 (a + x);
+    v.val[1] = vld1q_u8 (b + x);
+    vst2q_u8 (dst + 2 * x, v);
+  }
+#endif
+
+  for (; x < n; x++) {
+    dst[2 * x] = a[x];
+    dst[2 * x + 1] = b[x];
+  }
+}
+
+/* Pack a row of 4:2:2 planes as YUY2 (Y0 U Y1 V) or, with @uyvy, as UYVY
+ * (U Y0 V Y1). An odd last pixel is repeated to fill its pair */
+void
+gst_turbojpeg_pack_422_row (guint8 * dst, const guint8 * y,
+    const guint8 * u, const guint8 * v, gint width, gboolean uyvy)
+{
+  gint x = 0;
+
+#if defined (HAVE_AVX2)
+  for (; x + 32 <= width; x += 32) {
+    __m128i vu = _mm_loadu_si128 ((const __m128i *) (u + x / 2));
+    __m128i vv = _mm_loadu_si128 ((const __m128i *) (v + x / 2));
+    __m256i uv = _mm256_inserti128_si256 (_mm256_castsi128_si256
+        (_mm_unpacklo_epi8 (vu, vv)), _mm_unpackhi_epi8 (vu, vv), 1);
+    __m256i vy = _mm256_loadu_si256 ((const __m256i *) (y + x));
+    __m256i lo = uyvy ? _mm256_unpacklo_epi8 (uv, vy) :
+        _mm256_unpacklo_epi8 (vy, uv);
+    __m256i hi = uyvy ? _mm256_unpackhi_epi8 (uv, vy) :
+        _mm256_unpackhi_epi8 (vy, uv);
+    /* unpack works per 128-bit lane, put the halves back in order */
+    _mm256_storeu_si256 ((__m256i *) (dst + 2 * x),
+        _mm256_permute2x128_si256 (lo, hi, 0x20));
+    _mm256_storeu_si256 ((__m256i *) (dst + 2 * x + 32),
+        _mm256_permute2x128_si256 (lo, hi, 0x31));
+  }
+#endif
+#if defined (HAVE_SSE2)
+  for (; x + 16 <= width; x += 16) {
+    __m128i uv = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (u +
+                x / 2)), _mm_loadl_epi64 ((const __m128i *) (v + x / 2)));
+    __m128i vy = _mm_loadu_si128 ((const __m128i *) (y + x));
+
+    if (uyvy) {
+      _mm_storeu_si128 ((__m128i *) (dst + 2 * x), _mm_unpacklo_epi8 (uv, vy));
+      _mm_storeu_si128 ((__m128i *) (dst + 2 * x + 16),
+          _mm_unpackhi_epi8 (uv, vy));
+    } else {
+      _mm_storeu_si128 ((__m128i *) (dst + 2 * x), _mm_unpacklo_epi8 (vy, uv));
+      _mm_storeu_si128 ((__m128i *) (dst + 2 * x + 16),
+          _mm_unpackhi_epi8 (vy, uv));
+    }
+  }
+#elif defined (HAVE_NEON)
+  for (; x + 16 <= width; x += 16) {
+    uint8x8x2_t vy = vld2_u8 (y + x);
+    uint8x8_t vu = vld1_u8 (u + x / 2);
+    uint8x8_t vv = vld1_u8 (v + x / 2);
+    uint8x8x4_t out;
+
+    if (uyvy) {
+      out.val[0] = vu;
+      out.val[1] = vy.val[0];
+      out.val[2] = vv;
+      out.val[3] = vy.val[1];
+    } else {
+      out.val[0] = vy.val[0];
+      out.val[1] = vu;
+      out.val[2] = vy.val[1];
+      out.val[3] = vv;
+    }
+    vst4_u8 (dst + 2 * x, out);
+  }
+#endif
+
+  for (; x < width; x += 2) {
+    guint8 y0 = y[x];
+    guint8 y1 = x + 1 < width ? y[x + 1] : y0;
+    guint8 *out = dst + 2 * x;
+
+    if (uyvy) {
+      out[0] = u[x / 2];
+      out[1] = y0;
+      out[2] = v[x / 2];
+      out[3] = y1;
+    } else {
+      out[0] = y0;
+      out[1] = u[x / 2];
+      out[2] = y1;
+      out[3] = v[x / 2];
+    }
+  }
+}
+
+/* Split a row of packed 3-byte pixels into three planes: a[x] = src[3x],
+ * b[x] = src[3x + 1], c[x] = src[3x + 2] */
+void
+gst_turbojpeg_deinterleave3_row (guint8 * a, guint8 * b, guint8 * c,
+    const guint8 * src, gint n)
+{
+  gint x = 0;
+
+#if defined (HAVE_SSSE3)
+  {
+    /* Each output register gathers its bytes from the three inputs */
+    const __m128i a0 = _mm_setr_epi8 (0, 3, 6, 9, 12, 15, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1);
+    const __m128i a1 = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, 2, 5, 8, 11,
+        14, -1, -1, -1, -1, -1);
+    const __m128i a2 = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, 1, 4, 7, 10, 13);
+    const __m128i b0 = _mm_setr_epi8 (1, 4, 7, 10, 13, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8 (-1, -1, -1, -1, -1, 0, 3, 6, 9, 12,
+        15, -1, -1, -1, -1, -1);
+    const __m128i b2 = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, 2, 5, 8, 11, 14);
+    const __m128i c0 = _mm_setr_epi8 (2, 5, 8, 11, 14, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1);
+    const __m128i c1 = _mm_setr_epi8 (-1, -1, -1, -1, -1, 1, 4, 7, 10, 13,
+        -1, -1, -1, -1, -1, -1);
+    const __m128i c2 = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, 0, 3, 6, 9, 12, 15);
+
+    for (; x + 16 <= n; x += 16) {
+      __m128i v0 = _mm_loadu_si128 ((const __m128i *) (src + 3 * x));
+      __m128i v1 = _mm_loadu_si128 ((const __m128i *) (src + 3 * x + 16));
+      __m128i v2 = _mm_loadu_si128 ((const __m128i *) (src + 3 * x + 32));
+
+      _mm_storeu_si128 ((__m128i *) (a + x),
+          _mm_or_si128 (_mm_or_si128 (_mm_shuffle_epi8 (v0, a0),
+                  _mm_shuffle_epi8 (v1, a1)), _mm_shuffle_epi8 (v2, a2)));
+      _mm_storeu_si128 ((__m128i *) (b + x),
+          _mm_or_si128 (_mm_or_si128 (_mm_shuffle_epi8 (v0, b0),
+                  _mm_shuffle_epi8 (v1, b1)), _mm_shuffle_epi8 (v2, b2)));
+      _mm_storeu_si128 ((__m128i *) (c + x),
+          _mm_or_si128 (_mm_or_si128 (_mm_shuffle_epi8 (v0, c0),
+                  _mm_shuffle_epi8 (v1, c1)), _mm_shuffle_epi8 (v2, c2)));
+    }
+  }
+#elif defined (HAVE_NEON)
+  for (; x + 16 <= n; x += 16) {
+    uint8x16x3_t v = vld3q_u8 (src + 3 * x);
+
+    vst1q_u8 (a + x, v.val[0]);
+    vst1q_u8 (b + x, v.val[1]);
+    vst1q_u8 (c + x, v.val[2]);
+  }
+#endif
+
+  for (; x < n; x++) {
+    a[x] = src[3 * x];
+    b[x] = src[3 * x + 1];
+    c[x] = src[3 * x + 2];
+  }
+}
+
+/* Stretch @n samples of @precision (at least 8) bits to the full 16-bit
+ * range, by shifting them up and repeating their top bits below */
+void
+gst_turbojpeg_expand_samples_row (guint16 * row, gint n, gint precision)
+{
+  gint shift = 16 - precision;
+  gint x;
+
+  if (shift <= 0)
+    return;
+
+  for (x = 0; x < n; x++) {
+    guint v = row[x];
+
+    row[x] = (v << shift) | (v >> (precision - shift));
+  }
+}
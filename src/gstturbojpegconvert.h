@@ -0,0 +1,82 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_CONVERT_H__
+#define __GST_TURBOJPEG_CONVERT_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  GST_TURBOJPEG_RESAMPLE_COPY,
+  GST_TURBOJPEG_RESAMPLE_DOWN2,     /* 2:1 box filter */
+  GST_TURBOJPEG_RESAMPLE_UP2,       /* 1:2 bilinear (triangle) */
+  GST_TURBOJPEG_RESAMPLE_UP4        /* 1:4 bilinear */
+} GstTurboJpegResampleOp;
+
+typedef void (*GstTurboJpegHRowFunc) (guint8 * dst, const guint8 * src,
+    gint dst_w, gint src_w);
+typedef void (*GstTurboJpegBoxRowFunc) (guint8 * dst, const guint8 * a,
+    const guint8 * b, gint dst_w, gint src_w);
+typedef void (*GstTurboJpegBlendRowFunc) (guint8 * dst, const guint8 * a,
+    const guint8 * b, gint n, gint wa, gint wb, gint shift);
+
+/* Chroma plane resampling between two subsampling factors, resolved once
+ * when the output format is negotiated */
+typedef struct
+{
+  GstTurboJpegResampleOp h_op;
+  GstTurboJpegResampleOp v_op;
+  GstTurboJpegHRowFunc h_row;       /* NULL when h_op is COPY */
+  GstTurboJpegBoxRowFunc box_row;   /* Set when both ops are DOWN2 */
+  GstTurboJpegBlendRowFunc blend_row;
+} GstTurboJpegChromaPlan;
+
+gboolean gst_turbojpeg_chroma_plan_init (GstTurboJpegChromaPlan * plan,
+    gint src_h_factor, gint src_v_factor, gint dst_h_factor,
+    gint dst_v_factor);
+
+gsize gst_turbojpeg_chroma_scratch_size (gint dst_w);
+
+void gst_turbojpeg_chroma_resample (const GstTurboJpegChromaPlan * plan,
+    const guint8 * src, gint src_stride, gint src_w, gint src_h,
+    guint8 * dst, gint dst_stride, gint dst_w, gint dst_h, guint8 * scratch);
+
+void gst_turbojpeg_chroma_resample_rows (const GstTurboJpegChromaPlan * plan,
+    const guint8 * src, gint src_stride, gint src_w, gint src_h,
+    guint8 * dst, gint dst_stride, gint dst_w, gint dst_y, gint n_rows,
+    guint8 * scratch);
+
+void gst_turbojpeg_interleave_row (guint8 * dst, const guint8 * a,
+    const guint8 * b, gint n);
+
+void gst_turbojpeg_pack_422_row (guint8 * dst, const guint8 * y,
+    const guint8 * u, const guint8 * v, gint width, gboolean uyvy);
+
+void gst_turbojpeg_deinterleave3_row (guint8 * a, guint8 * b, guint8 * c,
+    const guint8 * src, gint n);
+
+void gst_turbojpeg_expand_samples_row (guint16 * row, gint n,
+    gint precision);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_CONVERT_H__ */
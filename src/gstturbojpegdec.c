@@ -27,6 +27,10 @@
 #include <string.h>
 
 #include "gstturbojpegdec.h"
+#include "gstturbojpegscan.h"
+#include "gstturbojpegarena.h"
+#include "gstturbojpeglazy.h"
+#include "gstturbojpegmeta.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_turbojpegdec_debug);
 #define GST_CAT_DEFAULT gst_turbojpegdec_debug
@@ -34,10 +38,89 @@ GST_DEBUG_CATEGORY_STATIC (gst_turbojpegdec_debug);
 enum
 {
   PROP_0,
-  PROP_MAX_ERRORS
+  PROP_MAX_ERRORS,
+  PROP_N_THREADS,
+  PROP_SLICE_THREADS,
+  PROP_SCRATCH_HIGH_WATER,
+  PROP_SCALE,
+  PROP_ROI_X,
+  PROP_ROI_Y,
+  PROP_ROI_WIDTH,
+  PROP_ROI_HEIGHT,
+  PROP_ADAPTIVE_SCALE,
+  PROP_LUMA_ONLY,
+  PROP_MCU_PADDED,
+  PROP_SKIP_DUPLICATES,
+  PROP_DUPLICATE_HITS,
+  PROP_DUPLICATE_MISSES,
+  PROP_CACHE_SIZE,
+  PROP_CACHE_HITS,
+  PROP_CACHE_MISSES,
+  PROP_CACHE_EVICTIONS,
+  PROP_LAZY_DECODE
 };
 
 #define DEFAULT_MAX_ERRORS 10
+#define DEFAULT_N_THREADS 1
+#define DEFAULT_SLICE_THREADS 1
+#define DEFAULT_SCALE_N 1
+#define DEFAULT_SCALE_D 1
+#define DEFAULT_ADAPTIVE_SCALE FALSE
+#define DEFAULT_LUMA_ONLY FALSE
+#define DEFAULT_MCU_PADDED FALSE
+#define DEFAULT_SKIP_DUPLICATES FALSE
+#define DEFAULT_CACHE_SIZE 0
+#define DEFAULT_LAZY_DECODE FALSE
+
+/* Adaptive scaling steps down to 1/2^ADAPTIVE_MAX_LEVEL. After a change,
+ * lateness is ignored for a few frames while QoS catches up, and a step up
+ * needs a long run of frames decoded with a frame duration to spare */
+#define ADAPTIVE_MAX_LEVEL 2
+#define ADAPTIVE_SETTLE_FRAMES 15
+#define ADAPTIVE_RECOVER_FRAMES 60
+#define ADAPTIVE_DEFAULT_SLACK (GST_SECOND / 30)
+
+/* Output chroma rows resampled and interleaved or packed at a time, and
+ * the height restart-marker bands are aimed at, so the semi-planar and
+ * packed YUV paths work on scratch that stays in cache */
+#define STRIP_ROWS 16
+#define BAND_ROWS 64
+
+/* TurboJPEG pads planes to at most 4 samples, for 4:1:1 and 4:4:1 MCUs */
+#define MCU_PLANE_PADDING 3
+
+/* Custom upstream event carrying a new region of interest as the int
+ * fields x, y, width and height, in JPEG pixels */
+#define ROI_EVENT_NAME "turbojpegdec-roi"
+#define MAX_N_THREADS 64
+
+/* Per-frame decode parameters, captured on the streaming thread so that
+ * workers never read element state that may change underneath them */
+typedef struct
+{
+  gint width;                 /* Output size, after scaling */
+  gint height;
+  gint subsamp;
+  gint precision;             /* Bits per sample */
+  tjscalingfactor scale;
+  tjregion region;            /* JPEG area to crop on decode, w == 0 if none */
+  gboolean convert;           /* Resample chroma through scratch planes */
+  gboolean padded;            /* Pool pads frames for MCU-padded planes */
+  GstTurboJpegChromaPlan chroma;
+} GstTurboJpegDecParams;
+
+/* A frame handed to the worker pool */
+typedef struct
+{
+  GstVideoCodecFrame *frame;
+  GstMapInfo map_info;
+  GstVideoFrame video_frame;
+  GstTurboJpegDecParams params;
+  GstFlowReturn ret;
+  gboolean done;
+  gboolean skipped;           /* Late frame, dropped without decoding */
+  gboolean reused;            /* Repeated frame, pushed with the last output */
+} GstTurboJpegDecJob;
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -45,10 +128,27 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_STATIC_CAPS ("image/jpeg")
     );
 
+/* TurboJPEG writes samples wider than 8 bits in host order */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define GRAY16_FORMAT GST_VIDEO_FORMAT_GRAY16_LE
+#define GRAY16_FORMAT_NAME "GRAY16_LE"
+#else
+#define GRAY16_FORMAT GST_VIDEO_FORMAT_GRAY16_BE
+#define GRAY16_FORMAT_NAME "GRAY16_BE"
+#endif
+
+/* RGBP only exists since GStreamer 1.20 */
+#if GST_CHECK_VERSION (1, 20, 0)
+#define PLANAR_RGB_FORMATS "GBR, RGBP"
+#else
+#define PLANAR_RGB_FORMATS "GBR"
+#endif
+
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ I420, YV12, Y42B, Y444, RGB, BGR, RGBx, BGRx, GRAY8 }"))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ I420, YV12, Y42B, Y444, NV12, NV21, YUY2, UYVY, RGB, BGR, RGBx, BGRx, xRGB, xBGR, RGBA, BGRA, ARGB, ABGR, "
+            PLANAR_RGB_FORMATS ", GRAY8, " GRAY16_FORMAT_NAME ", ARGB64 }"))
     );
 
 #define gst_turbojpegdec_parent_class parent_class
@@ -75,6 +175,17 @@ static GstFlowReturn gst_turbojpegdec_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame);
 static gboolean gst_turbojpegdec_decide_allocation (GstVideoDecoder * decoder,
     GstQuery * query);
+static GstFlowReturn gst_turbojpegdec_finish (GstVideoDecoder * decoder);
+static void gst_turbojpegdec_worker_func (gpointer data, gpointer user_data);
+static void gst_turbojpegdec_slice_func (gpointer data, gpointer user_data);
+static void gst_turbojpegdec_discard_pending (GstTurboJpegDec * dec);
+static void gst_turbojpegdec_reset_duplicates (GstTurboJpegDec * dec);
+static GstFlowReturn gst_turbojpegdec_drain (GstVideoDecoder * decoder);
+static gboolean gst_turbojpegdec_flush (GstVideoDecoder * decoder);
+static gboolean gst_turbojpegdec_src_event (GstVideoDecoder * decoder,
+    GstEvent * event);
+static gboolean gst_turbojpegdec_transform_meta (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame, GstMeta * meta);
 
 static void
 gst_turbojpegdec_class_init (GstTurboJpegDecClass * klass)
@@ -97,6 +208,141 @@ gst_turbojpegdec_class_init (GstTurboJpegDecClass * klass)
           0, G_MAXINT, DEFAULT_MAX_ERRORS,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+      g_param_spec_int ("n-threads", "Number of threads",
+          "Number of frames decoded in parallel (0 = number of CPUs, "
+          "1 = decode on the streaming thread). Adds n-threads - 1 frames "
+          "of latency",
+          0, MAX_N_THREADS, DEFAULT_N_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SLICE_THREADS,
+      g_param_spec_int ("slice-threads", "Slice threads",
+          "Number of threads decoding bands of a single frame split at "
+          "restart markers (0 = number of CPUs, 1 = disabled). Only used "
+          "when n-threads is 1; adds no latency",
+          0, GST_TURBOJPEG_MAX_BANDS, DEFAULT_SLICE_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SCRATCH_HIGH_WATER,
+      g_param_spec_uint64 ("scratch-high-water", "Scratch high-water mark",
+          "Largest number of bytes held at once by the scratch planes used "
+          "for chroma conversion",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SCALE,
+      gst_param_spec_fraction ("scale", "Scale",
+          "DCT-domain scaling factor applied while decoding (1/8 to 2/1 in "
+          "steps of 1/8; 0/1 = smallest factor up to 1/1 whose output covers "
+          "the size downstream accepts nearest to the JPEG's). Lossless "
+          "JPEGs are never scaled",
+          0, 1, 2, 1, DEFAULT_SCALE_N, DEFAULT_SCALE_D,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_X,
+      g_param_spec_int ("roi-x", "ROI x",
+          "Left edge of the region of interest, in JPEG pixels",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_Y,
+      g_param_spec_int ("roi-y", "ROI y",
+          "Top edge of the region of interest, in JPEG pixels",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_WIDTH,
+      g_param_spec_int ("roi-width", "ROI width",
+          "Width of the region of interest to decode, in JPEG pixels "
+          "(0 = whole frame). Also settable with a custom upstream \""
+          ROI_EVENT_NAME "\" event",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_HEIGHT,
+      g_param_spec_int ("roi-height", "ROI height",
+          "Height of the region of interest to decode, in JPEG pixels "
+          "(0 = whole frame)",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_SCALE,
+      g_param_spec_boolean ("adaptive-scale", "Adaptive scale",
+          "Lower the decode scale to 1/2 and then 1/4 while frames are late "
+          "instead of dropping them, and restore it once the decoder has "
+          "caught up",
+          DEFAULT_ADAPTIVE_SCALE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LUMA_ONLY,
+      g_param_spec_boolean ("luma-only", "Luma only",
+          "Prefer GRAY8 output whenever downstream accepts it. Chroma of "
+          "colour JPEGs then skips the IDCT and colour conversion",
+          DEFAULT_LUMA_ONLY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MCU_PADDED,
+      g_param_spec_boolean ("mcu-padded", "MCU padded",
+          "Negotiate planar YUV at the iMCU-padded size TurboJPEG decodes "
+          "to and describe the visible area with a crop meta, when "
+          "downstream supports crop metas",
+          DEFAULT_MCU_PADDED,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SKIP_DUPLICATES,
+      g_param_spec_boolean ("skip-duplicates", "Skip duplicates",
+          "Hash every compressed frame and push a frame identical to the "
+          "previous one with the previous output instead of decoding it",
+          DEFAULT_SKIP_DUPLICATES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DUPLICATE_HITS,
+      g_param_spec_uint64 ("duplicate-hits", "Duplicate hits",
+          "Frames pushed with the output of the identical frame before them",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DUPLICATE_MISSES,
+      g_param_spec_uint64 ("duplicate-misses", "Duplicate misses",
+          "Frames decoded while skip-duplicates is enabled",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_SIZE,
+      g_param_spec_uint64 ("cache-size", "Cache size",
+          "Bytes of decoded frames kept for JPEGs that recur, looked up by "
+          "a hash of the compressed frame (0 = disabled)",
+          0, G_MAXUINT64, DEFAULT_CACHE_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_HITS,
+      g_param_spec_uint64 ("cache-hits", "Cache hits",
+          "Frames pushed from the decoded frame cache",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_MISSES,
+      g_param_spec_uint64 ("cache-misses", "Cache misses",
+          "Frames looked up in the decoded frame cache and decoded",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CACHE_EVICTIONS,
+      g_param_spec_uint64 ("cache-evictions", "Cache evictions",
+          "Frames dropped from the decoded frame cache to stay within "
+          "cache-size",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LAZY_DECODE,
+      g_param_spec_boolean ("lazy-decode", "Lazy decode",
+          "Push frames backed by memory that decodes the JPEG when first "
+          "mapped, so frames dropped downstream are never decoded. Bypasses "
+          "downstream buffer pools",
+          DEFAULT_LAZY_DECODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_static_pad_template (element_class, &sink_template);
   gst_element_class_add_static_pad_template (element_class, &src_template);
 
@@ -110,6 +356,12 @@ gst_turbojpegdec_class_init (GstTurboJpegDecClass * klass)
   vdec_class->set_format = GST_DEBUG_FUNCPTR (gst_turbojpegdec_set_format);
   vdec_class->handle_frame = GST_DEBUG_FUNCPTR (gst_turbojpegdec_handle_frame);
   vdec_class->decide_allocation = GST_DEBUG_FUNCPTR (gst_turbojpegdec_decide_allocation);
+  vdec_class->finish = GST_DEBUG_FUNCPTR (gst_turbojpegdec_finish);
+  vdec_class->drain = GST_DEBUG_FUNCPTR (gst_turbojpegdec_drain);
+  vdec_class->flush = GST_DEBUG_FUNCPTR (gst_turbojpegdec_flush);
+  vdec_class->src_event = GST_DEBUG_FUNCPTR (gst_turbojpegdec_src_event);
+  vdec_class->transform_meta =
+      GST_DEBUG_FUNCPTR (gst_turbojpegdec_transform_meta);
 
   GST_DEBUG_CATEGORY_INIT (gst_turbojpegdec_debug, "turbojpegdec", 0,
       "TurboJPEG decoder");
@@ -126,6 +378,35 @@ gst_turbojpegdec_init (GstTurboJpegDec * dec)
   dec->input_state = NULL;
   dec->output_state = NULL;
 
+  dec->n_threads = DEFAULT_N_THREADS;
+  dec->pool = NULL;
+  dec->handles = NULL;
+  g_queue_init (&dec->pending);
+  dec->slice_threads = DEFAULT_SLICE_THREADS;
+  dec->slice_pool = NULL;
+  dec->slice_handles = NULL;
+  dec->slice_storage = g_byte_array_new ();
+  g_mutex_init (&dec->lock);
+  g_cond_init (&dec->cond);
+  dec->chroma_subsamp = TJSAMP_UNKNOWN;
+  dec->chroma_convert = FALSE;
+  dec->arena = gst_turbojpeg_arena_new ();
+  dec->scale_n = DEFAULT_SCALE_N;
+  dec->scale_d = DEFAULT_SCALE_D;
+  dec->scale_changed = FALSE;
+  dec->scaling = TJUNSCALED;
+  dec->tjInstanceTransform = NULL;
+  dec->region = TJUNCROPPED;
+  dec->header_key = g_byte_array_new ();
+  dec->header_valid = FALSE;
+  dec->adaptive_scale = DEFAULT_ADAPTIVE_SCALE;
+  dec->luma_only = DEFAULT_LUMA_ONLY;
+  dec->mcu_padded = DEFAULT_MCU_PADDED;
+  dec->skip_duplicates = DEFAULT_SKIP_DUPLICATES;
+  dec->cache = gst_turbojpeg_cache_new ();
+  dec->lazy_decode = DEFAULT_LAZY_DECODE;
+  dec->lazy_handles = g_async_queue_new_full ((GDestroyNotify) tj3Destroy);
+
   gst_video_decoder_set_packetized (GST_VIDEO_DECODER (dec), TRUE);
 }
 
@@ -139,9 +420,33 @@ gst_turbojpegdec_finalize (GObject * object)
   if (dec->output_state)
     gst_video_codec_state_unref (dec->output_state);
 
+  g_byte_array_unref (dec->slice_storage);
+  gst_turbojpeg_arena_free (dec->arena);
+  g_byte_array_unref (dec->header_key);
+  gst_buffer_replace (&dec->dup_output, NULL);
+  gst_turbojpeg_cache_free (dec->cache);
+  g_async_queue_unref (dec->lazy_handles);
+  g_mutex_clear (&dec->lock);
+  g_cond_clear (&dec->cond);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static gboolean
+gst_turbojpegdec_scale_supported (gint num, gint denom)
+{
+  tjscalingfactor *factors;
+  gint n_factors, i;
+
+  factors = tj3GetScalingFactors (&n_factors);
+  for (i = 0; factors && i < n_factors; i++) {
+    if ((gint64) factors[i].num * denom == (gint64) num * factors[i].denom)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
 static void
 gst_turbojpegdec_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
@@ -152,6 +457,76 @@ gst_turbojpegdec_set_property (GObject * object, guint prop_id,
     case PROP_MAX_ERRORS:
       dec->max_errors = g_value_get_int (value);
       break;
+    case PROP_N_THREADS:
+      dec->n_threads = g_value_get_int (value);
+      break;
+    case PROP_SLICE_THREADS:
+      dec->slice_threads = g_value_get_int (value);
+      break;
+    case PROP_SCALE:{
+      gint num = gst_value_get_fraction_numerator (value);
+      gint denom = gst_value_get_fraction_denominator (value);
+
+      if (num != 0 && !gst_turbojpegdec_scale_supported (num, denom)) {
+        GST_WARNING_OBJECT (dec, "Unsupported scaling factor %d/%d", num,
+            denom);
+        break;
+      }
+      GST_OBJECT_LOCK (dec);
+      dec->scale_n = num;
+      dec->scale_d = denom;
+      dec->scale_changed = TRUE;
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    }
+    case PROP_ADAPTIVE_SCALE:
+      dec->adaptive_scale = g_value_get_boolean (value);
+      break;
+    case PROP_LUMA_ONLY:
+      GST_OBJECT_LOCK (dec);
+      dec->luma_only = g_value_get_boolean (value);
+      dec->luma_only_changed = TRUE;
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_MCU_PADDED:
+      GST_OBJECT_LOCK (dec);
+      dec->mcu_padded = g_value_get_boolean (value);
+      dec->mcu_padded_changed = TRUE;
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_SKIP_DUPLICATES:
+      dec->skip_duplicates = g_value_get_boolean (value);
+      break;
+    case PROP_CACHE_SIZE:
+      gst_turbojpeg_cache_set_budget (dec->cache, g_value_get_uint64 (value));
+      break;
+    case PROP_LAZY_DECODE:
+      dec->lazy_decode = g_value_get_boolean (value);
+      break;
+    case PROP_ROI_X:
+      GST_OBJECT_LOCK (dec);
+      dec->roi_x = g_value_get_int (value);
+      dec->roi_changed = TRUE;
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_ROI_Y:
+      GST_OBJECT_LOCK (dec);
+      dec->roi_y = g_value_get_int (value);
+      dec->roi_changed = TRUE;
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_ROI_WIDTH:
+      GST_OBJECT_LOCK (dec);
+      dec->roi_width = g_value_get_int (value);
+      dec->roi_changed = TRUE;
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_ROI_HEIGHT:
+      GST_OBJECT_LOCK (dec);
+      dec->roi_height = g_value_get_int (value);
+      dec->roi_changed = TRUE;
+      GST_OBJECT_UNLOCK (dec);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -168,12 +543,191 @@ gst_turbojpegdec_get_property (GObject * object, guint prop_id,
     case PROP_MAX_ERRORS:
       g_value_set_int (value, dec->max_errors);
       break;
+    case PROP_N_THREADS:
+      g_value_set_int (value, dec->n_threads);
+      break;
+    case PROP_SLICE_THREADS:
+      g_value_set_int (value, dec->slice_threads);
+      break;
+    case PROP_SCALE:
+      GST_OBJECT_LOCK (dec);
+      gst_value_set_fraction (value, dec->scale_n, dec->scale_d);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_ADAPTIVE_SCALE:
+      g_value_set_boolean (value, dec->adaptive_scale);
+      break;
+    case PROP_LUMA_ONLY:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_boolean (value, dec->luma_only);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_MCU_PADDED:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_boolean (value, dec->mcu_padded);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_SKIP_DUPLICATES:
+      g_value_set_boolean (value, dec->skip_duplicates);
+      break;
+    case PROP_DUPLICATE_HITS:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_uint64 (value, dec->dup_hits);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_DUPLICATE_MISSES:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_uint64 (value, dec->dup_misses);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_CACHE_SIZE:
+      g_value_set_uint64 (value, gst_turbojpeg_cache_get_budget (dec->cache));
+      break;
+    case PROP_LAZY_DECODE:
+      g_value_set_boolean (value, dec->lazy_decode);
+      break;
+    case PROP_CACHE_HITS:
+    case PROP_CACHE_MISSES:
+    case PROP_CACHE_EVICTIONS:{
+      guint64 stats[3];
+
+      gst_turbojpeg_cache_get_stats (dec->cache, &stats[0], &stats[1],
+          &stats[2]);
+      g_value_set_uint64 (value, stats[prop_id - PROP_CACHE_HITS]);
+      break;
+    }
+    case PROP_ROI_X:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_int (value, dec->roi_x);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_ROI_Y:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_int (value, dec->roi_y);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_ROI_WIDTH:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_int (value, dec->roi_width);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_ROI_HEIGHT:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_int (value, dec->roi_height);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    case PROP_SCRATCH_HIGH_WATER:
+      g_value_set_uint64 (value,
+          gst_turbojpeg_arena_get_high_water (dec->arena));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
+static void
+gst_turbojpegdec_free_pool (GThreadPool ** pool, GAsyncQueue ** handles)
+{
+  tjhandle handle;
+
+  if (*pool) {
+    /* Wait for the workers to exit before destroying their instances */
+    g_thread_pool_free (*pool, FALSE, TRUE);
+    *pool = NULL;
+  }
+
+  if (*handles) {
+    while ((handle = g_async_queue_try_pop (*handles)))
+      tj3Destroy (handle);
+    g_async_queue_unref (*handles);
+    *handles = NULL;
+  }
+}
+
+/* Create a pool of @n_threads exclusive workers together with one TurboJPEG
+ * instance per worker. A worker borrows an idle instance for the duration
+ * of a job so instances are never shared concurrently */
+static gboolean
+gst_turbojpegdec_create_pool (GstTurboJpegDec * dec, GFunc func,
+    gint n_threads, GThreadPool ** pool, GAsyncQueue ** handles)
+{
+  GError *err = NULL;
+  gint i;
+
+  *handles = g_async_queue_new ();
+  for (i = 0; i < n_threads; i++) {
+    tjhandle handle = tj3Init (TJINIT_DECOMPRESS);
+    if (!handle) {
+      GST_ERROR_OBJECT (dec, "Failed to initialize TurboJPEG worker instance");
+      gst_turbojpegdec_free_pool (pool, handles);
+      return FALSE;
+    }
+    g_async_queue_push (*handles, handle);
+  }
+
+  *pool = g_thread_pool_new (func, dec, n_threads, TRUE, &err);
+  if (!*pool) {
+    GST_ERROR_OBJECT (dec, "Failed to create decoder thread pool: %s",
+        err ? err->message : "unknown error");
+    g_clear_error (&err);
+    gst_turbojpegdec_free_pool (pool, handles);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_turbojpegdec_stop_workers (GstTurboJpegDec * dec)
+{
+  if (dec->pool)
+    gst_turbojpegdec_discard_pending (dec);
+
+  gst_turbojpegdec_free_pool (&dec->pool, &dec->handles);
+  gst_turbojpegdec_free_pool (&dec->slice_pool, &dec->slice_handles);
+}
+
+static gint
+gst_turbojpegdec_resolve_threads (gint n_threads)
+{
+  if (n_threads == 0)
+    n_threads = MIN (g_get_num_processors (), MAX_N_THREADS);
+  return n_threads;
+}
+
+static gboolean
+gst_turbojpegdec_start_workers (GstTurboJpegDec * dec)
+{
+  gint n_threads = gst_turbojpegdec_resolve_threads (dec->n_threads);
+  gint slice_threads = gst_turbojpegdec_resolve_threads (dec->slice_threads);
+
+  if (n_threads > 1) {
+    if (!gst_turbojpegdec_create_pool (dec, gst_turbojpegdec_worker_func,
+            n_threads, &dec->pool, &dec->handles))
+      return FALSE;
+
+    /* Frame workers already keep every core busy */
+    if (slice_threads > 1)
+      GST_INFO_OBJECT (dec, "Ignoring slice-threads when n-threads is set");
+
+    GST_DEBUG_OBJECT (dec, "Decoding with %d threads", n_threads);
+    return TRUE;
+  }
+
+  if (slice_threads > 1) {
+    /* The streaming thread decodes the first slice itself */
+    if (!gst_turbojpegdec_create_pool (dec, gst_turbojpegdec_slice_func,
+            slice_threads - 1, &dec->slice_pool, &dec->slice_handles))
+      return FALSE;
+
+    GST_DEBUG_OBJECT (dec, "Decoding restart-marker slices with %d threads",
+        slice_threads);
+  }
+
+  return TRUE;
+}
+
 static gboolean
 gst_turbojpegdec_start (GstVideoDecoder * decoder)
 {
@@ -207,6 +761,19 @@ gst_turbojpegdec_start (GstVideoDecoder * decoder)
   }
 
   dec->error_count = 0;
+  GST_OBJECT_LOCK (dec);
+  dec->dup_hits = dec->dup_misses = 0;
+  GST_OBJECT_UNLOCK (dec);
+
+  if (!gst_turbojpegdec_start_workers (dec)) {
+    tj3Destroy (dec->tjInstanceHeader);
+    tj3Destroy (dec->tjInstanceRGB);
+    tj3Destroy (dec->tjInstanceYUV);
+    dec->tjInstanceHeader = NULL;
+    dec->tjInstanceRGB = NULL;
+    dec->tjInstanceYUV = NULL;
+    return FALSE;
+  }
 
   GST_DEBUG_OBJECT (dec, "TurboJPEG decoder started successfully");
   return TRUE;
@@ -219,6 +786,8 @@ gst_turbojpegdec_stop (GstVideoDecoder * decoder)
 
   GST_DEBUG_OBJECT (dec, "Stopping TurboJPEG decoder");
 
+  gst_turbojpegdec_stop_workers (dec);
+
   /* Cleanup TurboJPEG instances */
   if (dec->tjInstanceHeader) {
     tj3Destroy (dec->tjInstanceHeader);
@@ -235,6 +804,11 @@ gst_turbojpegdec_stop (GstVideoDecoder * decoder)
     dec->tjInstanceYUV = NULL;
   }
 
+  if (dec->tjInstanceTransform) {
+    tj3Destroy (dec->tjInstanceTransform);
+    dec->tjInstanceTransform = NULL;
+  }
+
   if (dec->input_state) {
     gst_video_codec_state_unref (dec->input_state);
     dec->input_state = NULL;
@@ -245,6 +819,22 @@ gst_turbojpegdec_stop (GstVideoDecoder * decoder)
     dec->output_state = NULL;
   }
 
+  dec->chroma_subsamp = TJSAMP_UNKNOWN;
+  dec->chroma_convert = FALSE;
+  dec->jpeg_width = dec->jpeg_height = 0;
+  dec->jpeg_precision = 0;
+  dec->scaling = TJUNSCALED;
+  dec->region = TJUNCROPPED;
+  dec->crop_width = dec->crop_height = 0;
+  g_byte_array_set_size (dec->header_key, 0);
+  dec->header_valid = FALSE;
+  dec->planes_padded = FALSE;
+  dec->adaptive_level = dec->negotiated_level = 0;
+  dec->adaptive_settle = dec->adaptive_good_frames = 0;
+  gst_turbojpegdec_reset_duplicates (dec);
+  gst_turbojpeg_cache_clear (dec->cache);
+  gst_turbojpeg_arena_reset (dec->arena);
+
   GST_DEBUG_OBJECT (dec, "TurboJPEG decoder stopped");
   return TRUE;
 }
@@ -260,6 +850,7 @@ gst_turbojpegdec_set_format (GstVideoDecoder * decoder,
   if (dec->input_state)
     gst_video_codec_state_unref (dec->input_state);
   dec->input_state = gst_video_codec_state_ref (state);
+  gst_turbojpegdec_reset_duplicates (dec);
 
   return TRUE;
 }
@@ -277,6 +868,19 @@ gst_turbojpegdec_get_tjpf_from_format (GstVideoFormat format)
       return TJPF_RGBX;
     case GST_VIDEO_FORMAT_BGRx:
       return TJPF_BGRX;
+    case GST_VIDEO_FORMAT_xRGB:
+      return TJPF_XRGB;
+    case GST_VIDEO_FORMAT_xBGR:
+      return TJPF_XBGR;
+      /* TurboJPEG writes an opaque alpha channel */
+    case GST_VIDEO_FORMAT_RGBA:
+      return TJPF_RGBA;
+    case GST_VIDEO_FORMAT_BGRA:
+      return TJPF_BGRA;
+    case GST_VIDEO_FORMAT_ARGB:
+      return TJPF_ARGB;
+    case GST_VIDEO_FORMAT_ABGR:
+      return TJPF_ABGR;
     case GST_VIDEO_FORMAT_GRAY8:
       return TJPF_GRAY;
     default:
@@ -284,329 +888,2027 @@ gst_turbojpegdec_get_tjpf_from_format (GstVideoFormat format)
   }
 }
 
-static GstFlowReturn
-gst_turbojpegdec_negotiate_format (GstTurboJpegDec * dec, gint width,
-    gint height, gint subsamp)
+/* Pixel format of 16-bit formats, fed from tj3Decompress12/16 */
+static int
+gst_turbojpegdec_get_tjpf16_from_format (GstVideoFormat format)
 {
-  GstVideoDecoder *decoder = GST_VIDEO_DECODER (dec);
-  GstVideoFormat format;
-  GstVideoCodecState *output_state;
-  GstCaps *allowed_caps;
-  GstStructure *structure;
-  const gchar *format_str;
-
-  allowed_caps = gst_pad_get_allowed_caps (GST_VIDEO_DECODER_SRC_PAD (decoder));
-  if (!allowed_caps) {
-    allowed_caps = gst_pad_get_pad_template_caps (GST_VIDEO_DECODER_SRC_PAD (decoder));
+  switch (format) {
+    case GRAY16_FORMAT:
+      return TJPF_GRAY;
+    case GST_VIDEO_FORMAT_ARGB64:
+      return TJPF_ARGB;
+    default:
+      return -1;
   }
+}
 
-  allowed_caps = gst_caps_make_writable (allowed_caps);
-  allowed_caps = gst_caps_fixate (allowed_caps);
-
-  structure = gst_caps_get_structure (allowed_caps, 0);
-  format_str = gst_structure_get_string (structure, "format");
+/* Packed formats TurboJPEG writes itself, and so crops on decode */
+static gboolean
+gst_turbojpegdec_is_packed_tj_format (GstVideoFormat format)
+{
+  return gst_turbojpegdec_get_tjpf_from_format (format) >= 0 ||
+      gst_turbojpegdec_get_tjpf16_from_format (format) >= 0;
+}
 
-  if (format_str) {
-    format = gst_video_format_from_string (format_str);
-  } else {
-    format = GST_VIDEO_FORMAT_I420;
-  }
+static gboolean
+gst_turbojpegdec_is_yuv_format (GstVideoFormat format)
+{
+  return format == GST_VIDEO_FORMAT_I420 || format == GST_VIDEO_FORMAT_YV12 ||
+      format == GST_VIDEO_FORMAT_Y42B || format == GST_VIDEO_FORMAT_Y444;
+}
 
-  GST_DEBUG_OBJECT (dec, "Negotiated format: %s", gst_video_format_to_string (format));
+/* Semi-planar formats, whose chroma is interleaved from TurboJPEG's planes */
+static gboolean
+gst_turbojpegdec_is_nv_format (GstVideoFormat format)
+{
+  return format == GST_VIDEO_FORMAT_NV12 || format == GST_VIDEO_FORMAT_NV21;
+}
 
-  output_state = gst_video_decoder_set_output_state (decoder, format,
-      width, height, dec->input_state);
+/* Packed 4:2:2, whose rows are packed from TurboJPEG's planes */
+static gboolean
+gst_turbojpegdec_is_packed_yuv_format (GstVideoFormat format)
+{
+  return format == GST_VIDEO_FORMAT_YUY2 || format == GST_VIDEO_FORMAT_UYVY;
+}
 
-  if (dec->output_state)
-    gst_video_codec_state_unref (dec->output_state);
-  dec->output_state = gst_video_codec_state_ref (output_state);
+/* Planar RGB, de-interleaved from TurboJPEG's packed RGB output */
+static gboolean
+gst_turbojpegdec_is_planar_rgb_format (GstVideoFormat format)
+{
+#if GST_CHECK_VERSION (1, 20, 0)
+  if (format == GST_VIDEO_FORMAT_RGBP)
+    return TRUE;
+#endif
+  return format == GST_VIDEO_FORMAT_GBR;
+}
 
-  gst_caps_unref (allowed_caps);
+/* Formats decoded through TurboJPEG's YUV planes rather than its packed
+ * pixel output */
+static gboolean
+gst_turbojpegdec_decodes_to_planes (GstVideoFormat format)
+{
+  return gst_turbojpegdec_is_yuv_format (format) ||
+      gst_turbojpegdec_is_nv_format (format) ||
+      gst_turbojpegdec_is_packed_yuv_format (format);
+}
 
-  return gst_video_decoder_negotiate (decoder) ? GST_FLOW_OK : GST_FLOW_NOT_NEGOTIATED;
+/* Whether TurboJPEG's MCU-padded luma plane fits in an output plane of
+ * @stride bytes, so it can be decoded in place */
+static gboolean
+gst_turbojpegdec_luma_in_place (gint stride, gint width, gint height,
+    gint subsamp)
+{
+  return stride >= tj3YUVPlaneWidth (0, width, subsamp) &&
+      tj3YUVPlaneHeight (0, height, subsamp) == height;
 }
 
-static GstFlowReturn
-gst_turbojpegdec_decode_rgb (GstTurboJpegDec * dec, GstMapInfo * map_info,
-    GstVideoFrame * frame)
+/* Scratch bytes needed to decode @subsamp planes before resampling them
+ * into chroma planes @chroma_width wide */
+static gsize
+gst_turbojpegdec_scratch_size (gint width, gint height, gint subsamp,
+    gint chroma_width, gboolean luma_in_place)
 {
-  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (frame);
-  int tjpf = gst_turbojpegdec_get_tjpf_from_format (format);
-  guint8 *dest = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
-  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
-  gint width = GST_VIDEO_FRAME_WIDTH (frame);
-  gint height = GST_VIDEO_FRAME_HEIGHT (frame);
-  int ret;
+  gsize size = gst_turbojpeg_chroma_scratch_size (chroma_width);
+  gint c;
 
-  if (tjpf < 0) {
-    GST_ERROR_OBJECT (dec, "Unsupported RGB format: %s",
-        gst_video_format_to_string (format));
-    return GST_FLOW_ERROR;
-  }
+  for (c = luma_in_place ? 1 : 0; c < 3; c++)
+    size += (gsize) tj3YUVPlaneWidth (c, width, subsamp) *
+        tj3YUVPlaneHeight (c, height, subsamp);
 
-  /* Basic validation - ensure buffer has reasonable size */
-  if (!dest || stride <= 0) {
-    GST_ERROR_OBJECT (dec, "Invalid output buffer: dest=%p, stride=%d", dest, stride);
-    return GST_FLOW_ERROR;
-  }
+  return size;
+}
 
-  /* Validate input buffer */
-  if (!map_info->data || map_info->size == 0) {
-    GST_ERROR_OBJECT (dec, "Invalid input buffer");
-    return GST_FLOW_ERROR;
+/* Pick the kernels resampling the chroma of @subsamp JPEGs into the
+ * negotiated planar layout, so the per-frame path only runs them */
+static void
+gst_turbojpegdec_update_chroma_plan (GstTurboJpegDec * dec, gint subsamp)
+{
+  GstVideoInfo *info = &dec->output_state->info;
+  const GstVideoFormatInfo *finfo = info->finfo;
+  gint width = GST_VIDEO_INFO_WIDTH (info);
+  gint height = GST_VIDEO_INFO_HEIGHT (info);
+  gint src_h, src_v, dst_h, dst_v;
+
+  dec->chroma_subsamp = subsamp;
+  dec->chroma_convert = FALSE;
+  memset (&dec->chroma_plan, 0, sizeof (dec->chroma_plan));
+
+  /* Scratch planes sized for the previous layout are of no further use */
+  gst_turbojpeg_arena_reset (dec->arena);
+
+  if (!gst_turbojpegdec_decodes_to_planes (GST_VIDEO_FORMAT_INFO_FORMAT
+          (finfo)))
+    return;
+
+  /* Grayscale has no chroma to resample, it is filled with neutral grey */
+  if (subsamp == TJSAMP_GRAY) {
+    dec->chroma_convert = TRUE;
+    return;
+  }
+  if (subsamp < 0 || subsamp >= TJ_NUMSAMP)
+    return;
+
+  src_h = tjMCUWidth[subsamp] / 8;
+  src_v = tjMCUHeight[subsamp] / 8;
+  dst_h = 1 << GST_VIDEO_FORMAT_INFO_W_SUB (finfo, 1);
+  dst_v = 1 << GST_VIDEO_FORMAT_INFO_H_SUB (finfo, 1);
+  if (src_h == dst_h && src_v == dst_v)
+    return;
+
+  /* Semi-planar and packed scratch depends on how each frame is split, so
+   * nothing is reserved for it */
+  dec->chroma_convert = TRUE;
+  if (!gst_turbojpeg_chroma_plan_init (&dec->chroma_plan, src_h, src_v,
+          dst_h, dst_v)) {
+    GST_WARNING_OBJECT (dec, "No chroma conversion from %dx%d to %dx%d "
+        "subsampling", src_h, src_v, dst_h, dst_v);
+    return;
   }
 
-  GST_LOG_OBJECT (dec, "Decoding RGB: %dx%d, stride=%d, format=%s, tjpf=%d",
-      width, height, stride, gst_video_format_to_string (format), tjpf);
-
-  ret = tj3Decompress8 (dec->tjInstanceRGB, map_info->data, map_info->size,
-      dest, stride, tjpf);
+  GST_DEBUG_OBJECT (dec, "Resampling chroma from %dx%d to %dx%d subsampling",
+      src_h, src_v, dst_h, dst_v);
 
-  if (ret < 0) {
-    GST_ERROR_OBJECT (dec, "TurboJPEG decompression failed: %s",
-        tj3GetErrorStr (dec->tjInstanceRGB));
-    dec->error_count++;
-    if (dec->error_count >= dec->max_errors) {
-      GST_ELEMENT_ERROR (dec, STREAM, DECODE, 
-          ("Too many decode errors"), 
-          ("Error count reached maximum of %d", dec->max_errors));
-      return GST_FLOW_ERROR;
-    }
-    return GST_FLOW_ERROR;
-  }
+  if (!gst_turbojpegdec_is_yuv_format (GST_VIDEO_FORMAT_INFO_FORMAT (finfo)))
+    return;
 
-  return GST_FLOW_OK;
+  gst_turbojpeg_arena_reserve (dec->arena,
+      gst_turbojpegdec_scratch_size (width, height, subsamp,
+          MAX (GST_VIDEO_INFO_COMP_WIDTH (info, 1),
+              GST_VIDEO_INFO_COMP_WIDTH (info, 2)),
+          gst_turbojpegdec_luma_in_place (GST_VIDEO_INFO_PLANE_STRIDE (info,
+                  0), width, height, subsamp)));
 }
 
-static GstFlowReturn
-gst_turbojpegdec_decode_yuv (GstTurboJpegDec * dec, GstMapInfo * map_info,
-    GstVideoFrame * frame, gint subsamp, gint tj_width, gint tj_height)
+static void
+gst_turbojpegdec_update_latency (GstTurboJpegDec * dec)
 {
-  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (frame);
-  gint width = GST_VIDEO_FRAME_WIDTH (frame);
-  gint height = GST_VIDEO_FRAME_HEIGHT (frame);
-  unsigned char *gstPlanes[3];
-  int gstStrides[3];
-  int ret;
-  
-  GST_LOG_OBJECT (dec, "Direct YUV decoding: %dx%d, subsampling: %d, format: %s", 
-      width, height, subsamp, gst_video_format_to_string (format));
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (dec);
+  GstClockTime latency;
+  gint fps_n, fps_d, frames;
 
-  /* Get GStreamer plane pointers and strides */
-  gstPlanes[0] = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
-  gstStrides[0] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+  if (!dec->pool || !dec->input_state)
+    return;
 
-  if (format == GST_VIDEO_FORMAT_YV12) {
-    /* YV12 has V and U planes swapped */
-    gstPlanes[1] = GST_VIDEO_FRAME_PLANE_DATA (frame, 2);  /* V plane */
-    gstPlanes[2] = GST_VIDEO_FRAME_PLANE_DATA (frame, 1);  /* U plane */
-    gstStrides[1] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 2);
-    gstStrides[2] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 1);
-  } else {
-    /* I420, Y42B, Y444 */
-    gstPlanes[1] = GST_VIDEO_FRAME_PLANE_DATA (frame, 1);  /* U plane */
-    gstPlanes[2] = GST_VIDEO_FRAME_PLANE_DATA (frame, 2);  /* V plane */
-    gstStrides[1] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 1);
-    gstStrides[2] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 2);
-  }
-
-  /* Get detailed plane information for debugging */
-  gint gst_y_width = width;
-  gint gst_y_height = height;
-  gint gst_u_width = GST_VIDEO_FRAME_COMP_WIDTH (frame, 1);
-  gint gst_u_height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, 1);
-  gint gst_v_width = GST_VIDEO_FRAME_COMP_WIDTH (frame, 2);
-  gint gst_v_height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, 2);
-
-  /* Calculate expected TurboJPEG plane dimensions for this subsampling mode */
-  gint tj_y_width = tj3YUVPlaneWidth (0, tj_width, subsamp);
-  gint tj_u_width = tj3YUVPlaneWidth (1, tj_width, subsamp);
-  gint tj_v_width = tj3YUVPlaneWidth (2, tj_width, subsamp);
-  gint tj_y_height = tj3YUVPlaneHeight (0, tj_height, subsamp);
-  gint tj_u_height = tj3YUVPlaneHeight (1, tj_height, subsamp);
-  gint tj_v_height = tj3YUVPlaneHeight (2, tj_height, subsamp);
-
-  GST_WARNING_OBJECT (dec, "=== SUBSAMPLING DEBUG (mode=%d) ===", subsamp);
-  GST_WARNING_OBJECT (dec, "JPEG dimensions: %dx%d", tj_width, tj_height);
-  GST_WARNING_OBJECT (dec, "GStreamer Y plane: %dx%d stride=%d", gst_y_width, gst_y_height, gstStrides[0]);
-  GST_WARNING_OBJECT (dec, "GStreamer U plane: %dx%d stride=%d", gst_u_width, gst_u_height, gstStrides[1]);
-  GST_WARNING_OBJECT (dec, "GStreamer V plane: %dx%d stride=%d", gst_v_width, gst_v_height, gstStrides[2]);
-  GST_WARNING_OBJECT (dec, "TurboJPEG Y plane: %dx%d", tj_y_width, tj_y_height);
-  GST_WARNING_OBJECT (dec, "TurboJPEG U plane: %dx%d", tj_u_width, tj_u_height);
-  GST_WARNING_OBJECT (dec, "TurboJPEG V plane: %dx%d", tj_v_width, tj_v_height);
-  
-  /* Check for dimension mismatches - this indicates subsampling format conversion needed */
-  gboolean needs_conversion = FALSE;
-  if (gst_u_width != tj_u_width || gst_u_height != tj_u_height || 
-      gst_v_width != tj_v_width || gst_v_height != tj_v_height) {
-    GST_WARNING_OBJECT (dec, "Subsampling format conversion needed:");
-    GST_WARNING_OBJECT (dec, "JPEG subsampling: %d, Output format: %s", subsamp, gst_video_format_to_string (format));
-    GST_WARNING_OBJECT (dec, "U plane MISMATCH! GST: %dx%d vs TJ: %dx%d", gst_u_width, gst_u_height, tj_u_width, tj_u_height);
-    GST_WARNING_OBJECT (dec, "V plane MISMATCH! GST: %dx%d vs TJ: %dx%d", gst_v_width, gst_v_height, tj_v_width, tj_v_height);
-    needs_conversion = TRUE;
-  }
-
-  if (needs_conversion) {
-    /* We need to decode to intermediate buffers and convert subsampling format */
-    unsigned char *tjPlanes[3];
-    int tjStrides[3];
-    
-    /* Allocate TurboJPEG buffers with original subsampling format */
-    size_t tj_y_size = tj_y_width * tj_y_height;
-    size_t tj_u_size = tj_u_width * tj_u_height;  
-    size_t tj_v_size = tj_v_width * tj_v_height;
-    
-    tjPlanes[0] = g_malloc (tj_y_size);
-    tjPlanes[1] = g_malloc (tj_u_size);
-    tjPlanes[2] = g_malloc (tj_v_size);
-    
-    if (!tjPlanes[0] || !tjPlanes[1] || !tjPlanes[2]) {
-      GST_ERROR_OBJECT (dec, "Failed to allocate TurboJPEG conversion buffers");
-      g_free (tjPlanes[0]);
-      g_free (tjPlanes[1]);
-      g_free (tjPlanes[2]);
-      return GST_FLOW_ERROR;
-    }
-    
-    tjStrides[0] = tj_y_width;
-    tjStrides[1] = tj_u_width;
-    tjStrides[2] = tj_v_width;
-    
-    /* Decompress to TurboJPEG buffers with original subsampling */
-    ret = tj3DecompressToYUVPlanes8 (dec->tjInstanceYUV, map_info->data, map_info->size,
-        tjPlanes, tjStrides);
-        
-    if (ret < 0) {
-      GST_ERROR_OBJECT (dec, "TurboJPEG YUV decompression failed: %s",
-          tj3GetErrorStr (dec->tjInstanceYUV));
-      g_free (tjPlanes[0]);
-      g_free (tjPlanes[1]);
-      g_free (tjPlanes[2]);
-      return GST_FLOW_ERROR;
-    }
-    
-    /* Copy Y plane directly (no conversion needed) */
-    for (gint i = 0; i < gst_y_height; i++) {
-      memcpy (gstPlanes[0] + i * gstStrides[0], 
-              tjPlanes[0] + i * tjStrides[0], 
-              gst_y_width);
-    }
-    
-    /* Convert and copy U plane with subsampling */
-    for (gint y = 0; y < gst_u_height; y++) {
-      for (gint x = 0; x < gst_u_width; x++) {
-        /* Calculate source coordinates for downsampling */
-        gint src_x = x * tj_u_width / gst_u_width;
-        gint src_y = y * tj_u_height / gst_u_height;
-        
-        if (src_x < tj_u_width && src_y < tj_u_height) {
-          gstPlanes[1][y * gstStrides[1] + x] = tjPlanes[1][src_y * tjStrides[1] + src_x];
-        }
-      }
-    }
-    
-    /* Convert and copy V plane with subsampling */
-    for (gint y = 0; y < gst_v_height; y++) {
-      for (gint x = 0; x < gst_v_width; x++) {
-        /* Calculate source coordinates for downsampling */
-        gint src_x = x * tj_v_width / gst_v_width;
-        gint src_y = y * tj_v_height / gst_v_height;
-        
-        if (src_x < tj_v_width && src_y < tj_v_height) {
-          gstPlanes[2][y * gstStrides[2] + x] = tjPlanes[2][src_y * tjStrides[2] + src_x];
-        }
-      }
-    }
-    
-    /* Clean up intermediate buffers */
-    g_free (tjPlanes[0]);
-    g_free (tjPlanes[1]);
-    g_free (tjPlanes[2]);
-    
-    GST_WARNING_OBJECT (dec, "Subsampling format conversion completed");
-    
-  } else {
-    /* Direct YUV decompression when formats match */
-    ret = tj3DecompressToYUVPlanes8 (dec->tjInstanceYUV, map_info->data, map_info->size,
-        gstPlanes, gstStrides);
-  }
+  /* Frames are held back until every worker is busy */
+  frames = g_thread_pool_get_max_threads (dec->pool) - 1;
+  fps_n = GST_VIDEO_INFO_FPS_N (&dec->input_state->info);
+  fps_d = GST_VIDEO_INFO_FPS_D (&dec->input_state->info);
 
-  /* Error handling is done within each branch above */
-  if (ret < 0) {
-    dec->error_count++;
-    if (dec->error_count >= dec->max_errors) {
-      GST_ELEMENT_ERROR (dec, STREAM, DECODE, 
-          ("Too many decode errors"), 
-          ("Error count reached maximum of %d", dec->max_errors));
-      return GST_FLOW_ERROR;
-    }
-    return GST_FLOW_ERROR;
+  if (fps_n <= 0 || fps_d <= 0) {
+    GST_DEBUG_OBJECT (dec, "Unknown framerate, not reporting %d frames of "
+        "latency", frames);
+    return;
   }
 
-  GST_LOG_OBJECT (dec, "Direct YUV decompression successful");
-  return GST_FLOW_OK;
+  latency = gst_util_uint64_scale_ceil (frames * GST_SECOND, fps_d, fps_n);
+  GST_DEBUG_OBJECT (dec, "Reporting latency of %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (latency));
+  gst_video_decoder_set_latency (decoder, latency, latency);
 }
 
-static GstFlowReturn
-gst_turbojpegdec_handle_frame (GstVideoDecoder * decoder,
-    GstVideoCodecFrame * frame)
+/* Relative cost of decoding a @subsamp JPEG into @format, or -1 if it
+ * cannot be produced. Planes matching the JPEG are written directly.
+ * Packed RGB in any byte order, with or without alpha, costs TurboJPEG's
+ * colour conversion, and so does interleaving matching chroma for
+ * NV12/NV21 or YUY2/UYVY. Planar RGB and other YUV layouts take a second
+ * pass and dropping colour is the last resort. JPEGs with more than 8 bits
+ * per sample are only decoded to the 16-bit formats */
+static gint
+gst_turbojpegdec_format_cost (GstVideoFormat format, gint subsamp,
+    gint precision, gboolean lossless)
 {
-  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (decoder);
-  GstMapInfo map_info;
-  GstFlowReturn ret = GST_FLOW_OK;
-  GstVideoFrame video_frame;
-  gint width, height, subsamp;
-  gboolean format_changed = FALSE;
+  const GstVideoFormatInfo *finfo;
 
-  if (!gst_buffer_map (frame->input_buffer, &map_info, GST_MAP_READ)) {
-    GST_ERROR_OBJECT (dec, "Failed to map input buffer");
-    return GST_FLOW_ERROR;
+  /* Samples wider than 8 bits only fit the 16-bit formats */
+  if (precision > 8) {
+    if (format == GRAY16_FORMAT)
+      return subsamp == TJSAMP_GRAY ? 0 : 3;
+    return format == GST_VIDEO_FORMAT_ARGB64 ? 1 : -1;
   }
-
-  /* Validate input buffer */
-  if (!map_info.data || map_info.size < 4) {
-    GST_ERROR_OBJECT (dec, "Invalid or too small input buffer: size=%" G_GSIZE_FORMAT,
-        map_info.size);
-    gst_buffer_unmap (frame->input_buffer, &map_info);
-    return GST_FLOW_ERROR;
+  if (gst_turbojpegdec_get_tjpf16_from_format (format) >= 0)
+    return -1;
+
+  /* TurboJPEG has no YUV output for lossless JPEGs */
+  if (lossless && gst_turbojpegdec_get_tjpf_from_format (format) < 0)
+    return -1;
+
+  if (format == GST_VIDEO_FORMAT_GRAY8)
+    return subsamp == TJSAMP_GRAY ? 0 : 3;
+
+  if (gst_turbojpegdec_is_nv_format (format))
+    return subsamp == TJSAMP_420 ? 1 : 2;
+  if (gst_turbojpegdec_is_packed_yuv_format (format))
+    return subsamp == TJSAMP_422 ? 1 : 2;
+  if (gst_turbojpegdec_is_planar_rgb_format (format))
+    return 2;
+
+  if (gst_turbojpegdec_is_yuv_format (format)) {
+    if (subsamp < 0 || subsamp >= TJ_NUMSAMP || subsamp == TJSAMP_GRAY)
+      return 2;
+    finfo = gst_video_format_get_info (format);
+    if (tjMCUWidth[subsamp] / 8 == 1 << GST_VIDEO_FORMAT_INFO_W_SUB (finfo, 1)
+        && tjMCUHeight[subsamp] / 8 ==
+        1 << GST_VIDEO_FORMAT_INFO_H_SUB (finfo, 1))
+      return 0;
+    return 2;
   }
 
-  /* Check for JPEG magic bytes */
-  if (map_info.data[0] != 0xFF || map_info.data[1] != 0xD8) {
-    GST_ERROR_OBJECT (dec, "Invalid JPEG magic bytes: 0x%02X 0x%02X",
-        map_info.data[0], map_info.data[1]);
-    gst_buffer_unmap (frame->input_buffer, &map_info);
+  if (gst_turbojpegdec_get_tjpf_from_format (format) >= 0)
+    return 1;
+
+  return -1;
+}
+
+static void
+gst_turbojpegdec_rank_format (GstTurboJpegDec * dec, const GValue * value,
+    gint subsamp, gboolean luma_only, GstVideoFormat * best, gint * best_cost)
+{
+  GstVideoFormat format;
+  gint cost;
+
+  if (!G_VALUE_HOLDS_STRING (value))
+    return;
+
+  format = gst_video_format_from_string (g_value_get_string (value));
+  cost = gst_turbojpegdec_format_cost (format, subsamp, dec->jpeg_precision,
+      dec->jpeg_lossless);
+
+  /* Luma-only mode ranks grey ahead of every format carrying colour. Grey
+   * output already is libjpeg's cheapest decode: it marks Cb/Cr as not
+   * needed, so their Huffman data is decoded only to reach the luma
+   * blocks, never dequantised, transformed or colour converted */
+  if (luma_only && cost >= 0)
+    cost = format == GST_VIDEO_FORMAT_GRAY8 || format == GRAY16_FORMAT ?
+        0 : cost + 4;
+
+  /* Ties keep downstream's order of preference */
+  if (cost >= 0 && cost < *best_cost) {
+    *best = format;
+    *best_cost = cost;
+  }
+}
+
+/* Cheapest output format for @subsamp among those downstream accepts, for
+ * the precision and coding recorded in jpeg_precision and jpeg_lossless */
+static GstVideoFormat
+gst_turbojpegdec_choose_format (GstTurboJpegDec * dec, GstCaps * caps,
+    gint subsamp)
+{
+  GstVideoFormat best = GST_VIDEO_FORMAT_UNKNOWN;
+  gint best_cost = G_MAXINT;
+  gboolean luma_only;
+  guint i, j;
+
+  GST_OBJECT_LOCK (dec);
+  luma_only = dec->luma_only;
+  GST_OBJECT_UNLOCK (dec);
+
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    const GValue *formats =
+        gst_structure_get_value (gst_caps_get_structure (caps, i), "format");
+
+    if (!formats)
+      continue;
+
+    if (GST_VALUE_HOLDS_LIST (formats)) {
+      for (j = 0; j < gst_value_list_get_size (formats); j++)
+        gst_turbojpegdec_rank_format (dec, gst_value_list_get_value (formats,
+                j), subsamp, luma_only, &best, &best_cost);
+    } else {
+      gst_turbojpegdec_rank_format (dec, formats, subsamp, luma_only, &best,
+          &best_cost);
+    }
+  }
+
+  if (best == GST_VIDEO_FORMAT_UNKNOWN) {
+    if (dec->jpeg_precision > 8)
+      best = subsamp == TJSAMP_GRAY ? GRAY16_FORMAT : GST_VIDEO_FORMAT_ARGB64;
+    else if (dec->jpeg_lossless)
+      best = GST_VIDEO_FORMAT_RGB;
+    else
+      best = GST_VIDEO_FORMAT_I420;
+  }
+
+  GST_DEBUG_OBJECT (dec, "Picked %s for subsampling %d (cost %d)",
+      gst_video_format_to_string (best), subsamp, best_cost);
+
+  return best;
+}
+
+/* Smallest scaling factor, up to 1/1, whose output still covers the size
+ * downstream fixates to. The IDCT does most of the downscaling and a
+ * videoscale after the decoder only the remainder. Ranges are fixated
+ * towards the JPEG's own size, so a downstream that takes any size keeps
+ * full resolution */
+static tjscalingfactor
+gst_turbojpegdec_choose_scale (GstTurboJpegDec * dec, GstCaps * caps,
+    gint width, gint height)
+{
+  tjscalingfactor *factors;
+  tjscalingfactor best = TJUNSCALED;
+  GstStructure *s;
+  GstCaps *fixed;
+  gint target_width = width, target_height = height;
+  gint n_factors, i;
+
+  if (gst_caps_is_empty (caps))
+    return best;
+
+  fixed = gst_caps_truncate (gst_caps_copy (caps));
+  s = gst_caps_get_structure (fixed, 0);
+  gst_structure_fixate_field_nearest_int (s, "width", width);
+  gst_structure_fixate_field_nearest_int (s, "height", height);
+  gst_structure_get_int (s, "width", &target_width);
+  gst_structure_get_int (s, "height", &target_height);
+  gst_caps_unref (fixed);
+
+  factors = tj3GetScalingFactors (&n_factors);
+  for (i = 0; factors && i < n_factors; i++) {
+    tjscalingfactor sf = factors[i];
+
+    if (sf.num > sf.denom || sf.num * best.denom >= best.num * sf.denom)
+      continue;
+    if (TJSCALED (width, sf) >= target_width &&
+        TJSCALED (height, sf) >= target_height)
+      best = sf;
+  }
+
+  GST_DEBUG_OBJECT (dec, "Scaling %dx%d by %d/%d for %dx%d downstream",
+      width, height, best.num, best.denom, target_width, target_height);
+
+  return best;
+}
+
+/* Clip the region of interest to a @width x @height JPEG into @roi and
+ * widen it to the iMCU grid TurboJPEG crops on into @region. Returns FALSE
+ * when the whole frame has to be decoded */
+static gboolean
+gst_turbojpegdec_snap_roi (GstTurboJpegDec * dec, gint width, gint height,
+    gint subsamp, gboolean lossless, tjregion * roi, tjregion * region)
+{
+  gint mcu_w, mcu_h;
+
+  GST_OBJECT_LOCK (dec);
+  roi->x = dec->roi_x;
+  roi->y = dec->roi_y;
+  roi->w = dec->roi_width;
+  roi->h = dec->roi_height;
+  GST_OBJECT_UNLOCK (dec);
+
+  if (roi->w <= 0 || roi->h <= 0)
+    return FALSE;
+
+  if (lossless || subsamp < 0 || subsamp >= TJ_NUMSAMP) {
+    GST_WARNING_OBJECT (dec, "Cannot crop this JPEG, decoding whole frames");
+    return FALSE;
+  }
+
+  if (roi->x >= width || roi->y >= height) {
+    GST_WARNING_OBJECT (dec, "Region of interest lies outside the %dx%d "
+        "frame, decoding whole frames", width, height);
+    return FALSE;
+  }
+
+  roi->w = MIN (roi->w, width - roi->x);
+  roi->h = MIN (roi->h, height - roi->y);
+  if (roi->w == width && roi->h == height)
+    return FALSE;
+
+  mcu_w = tjMCUWidth[subsamp];
+  mcu_h = tjMCUHeight[subsamp];
+  region->x = roi->x / mcu_w * mcu_w;
+  region->y = roi->y / mcu_h * mcu_h;
+  region->w = roi->x + roi->w - region->x;
+  region->h = roi->y + roi->h - region->y;
+
+  return TRUE;
+}
+
+/* Cached frames only match the output configuration they were decoded
+ * for, which this hash stands for in the cache keys */
+static guint64
+gst_turbojpegdec_output_variant (GstTurboJpegDec * dec, GstVideoFormat format,
+    gint width, gint height, const tjregion * region)
+{
+  const gint variant[] = { format, width, height, dec->scaling.num,
+    dec->scaling.denom, region->x, region->y, region->w, region->h,
+    dec->crop_x, dec->crop_y, dec->crop_width, dec->crop_height
+  };
+
+  return gst_turbojpeg_hash ((const guint8 *) variant, sizeof (variant));
+}
+
+/* Whether downstream takes @format at the padded @width x @height and
+ * honours crop metas, asked with an allocation query ahead of the caps */
+static gboolean
+gst_turbojpegdec_downstream_crops (GstTurboJpegDec * dec,
+    GstCaps * allowed_caps, GstVideoFormat format, gint width, gint height)
+{
+  GstCaps *caps;
+  GstQuery *query;
+  gboolean ret = FALSE;
+
+  caps = gst_caps_new_simple ("video/x-raw",
+      "format", G_TYPE_STRING, gst_video_format_to_string (format),
+      "width", G_TYPE_INT, width, "height", G_TYPE_INT, height, NULL);
+
+  if (gst_caps_can_intersect (caps, allowed_caps)) {
+    query = gst_query_new_allocation (caps, FALSE);
+    if (gst_pad_peer_query (GST_VIDEO_DECODER_SRC_PAD (dec), query))
+      ret = gst_query_find_allocation_meta (query,
+          GST_VIDEO_CROP_META_API_TYPE, NULL);
+    gst_query_unref (query);
+  }
+
+  gst_caps_unref (caps);
+  return ret;
+}
+
+static GstFlowReturn
+gst_turbojpegdec_negotiate_format (GstTurboJpegDec * dec, gint width,
+    gint height, gint subsamp, gboolean lossless, gint precision)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (dec);
+  GstVideoFormat format;
+  GstCaps *allowed_caps;
+  tjscalingfactor scale;
+  tjregion roi, region;
+  gint out_width, out_height, padded_width, padded_height;
+  gboolean mcu_padded;
+
+  allowed_caps = gst_pad_get_allowed_caps (GST_VIDEO_DECODER_SRC_PAD (decoder));
+  if (!allowed_caps) {
+    allowed_caps = gst_pad_get_pad_template_caps (GST_VIDEO_DECODER_SRC_PAD (decoder));
+  }
+
+  GST_OBJECT_LOCK (dec);
+  scale.num = dec->scale_n;
+  scale.denom = dec->scale_d;
+  mcu_padded = dec->mcu_padded;
+  GST_OBJECT_UNLOCK (dec);
+
+  if (!gst_turbojpegdec_snap_roi (dec, width, height, subsamp, lossless,
+          &roi, &region)) {
+    roi.x = roi.y = 0;
+    region = TJUNCROPPED;
+    region.w = width;
+    region.h = height;
+  }
+
+  /* TurboJPEG refuses to scale lossless JPEGs */
+  if (lossless)
+    scale = TJUNSCALED;
+  else if (scale.num == 0)
+    scale = gst_turbojpegdec_choose_scale (dec, allowed_caps, region.w,
+        region.h);
+
+  /* Scale cap while adapting to load */
+  dec->negotiated_level = dec->adaptive_level;
+  if (!lossless && dec->adaptive_level > 0 &&
+      scale.num << dec->adaptive_level > scale.denom) {
+    scale.num = 1;
+    scale.denom = 1 << dec->adaptive_level;
+  }
+
+  dec->jpeg_width = width;
+  dec->jpeg_height = height;
+  dec->jpeg_lossless = lossless;
+  dec->jpeg_precision = precision;
+  dec->scaling = scale;
+  out_width = TJSCALED (region.w, scale);
+  out_height = TJSCALED (region.h, scale);
+
+  /* The region ends where the ROI does, only its start can be off grid */
+  dec->crop_x = (roi.x - region.x) * scale.num / scale.denom;
+  dec->crop_y = (roi.y - region.y) * scale.num / scale.denom;
+  dec->crop_width = dec->crop_x || dec->crop_y ? out_width - dec->crop_x : 0;
+  dec->crop_height = out_height - dec->crop_y;
+  if (region.w == width && region.h == height)
+    dec->region = TJUNCROPPED;
+  else
+    dec->region = region;
+
+  format = gst_turbojpegdec_choose_format (dec, allowed_caps, subsamp);
+
+  /* Planes matching the JPEG's are decoded at their iMCU-padded size, so
+   * with the padding hidden by a crop meta odd sizes stay conversion-free */
+  if (mcu_padded && gst_turbojpegdec_is_yuv_format (format) &&
+      gst_turbojpegdec_format_cost (format, subsamp, precision,
+          lossless) == 0) {
+    padded_width = tj3YUVPlaneWidth (0, out_width, subsamp);
+    padded_height = tj3YUVPlaneHeight (0, out_height, subsamp);
+    if ((padded_width != out_width || padded_height != out_height) &&
+        gst_turbojpegdec_downstream_crops (dec, allowed_caps, format,
+            padded_width, padded_height)) {
+      dec->crop_width = out_width - dec->crop_x;
+      out_width = padded_width;
+      out_height = padded_height;
+    }
+  }
+  gst_caps_unref (allowed_caps);
+
+  dec->cache_variant = gst_turbojpegdec_output_variant (dec, format,
+      out_width, out_height, &region);
+
+  /* A subsampling change may still be served best by the current caps */
+  if (dec->output_state &&
+      GST_VIDEO_INFO_FORMAT (&dec->output_state->info) == format &&
+      GST_VIDEO_INFO_WIDTH (&dec->output_state->info) == out_width &&
+      GST_VIDEO_INFO_HEIGHT (&dec->output_state->info) == out_height) {
+    gst_turbojpegdec_update_chroma_plan (dec, subsamp);
+    return GST_FLOW_OK;
+  }
+
+  GST_DEBUG_OBJECT (dec, "Negotiated format: %s, %dx%d (scale %d/%d)",
+      gst_video_format_to_string (format), out_width, out_height, scale.num,
+      scale.denom);
+
+  if (dec->output_state)
+    gst_video_codec_state_unref (dec->output_state);
+  dec->output_state = gst_video_decoder_set_output_state (decoder, format,
+      out_width, out_height, dec->input_state);
+
+  gst_turbojpegdec_update_chroma_plan (dec, subsamp);
+  gst_turbojpegdec_update_latency (dec);
+
+  return gst_video_decoder_negotiate (decoder) ? GST_FLOW_OK : GST_FLOW_NOT_NEGOTIATED;
+}
+
+static GstFlowReturn
+gst_turbojpegdec_decode_rgb (GstTurboJpegDec * dec, tjhandle handle,
+    GstMapInfo * map_info, GstVideoFrame * frame)
+{
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (frame);
+  int tjpf = gst_turbojpegdec_get_tjpf_from_format (format);
+  guint8 *dest = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+  gint width = GST_VIDEO_FRAME_WIDTH (frame);
+  gint height = GST_VIDEO_FRAME_HEIGHT (frame);
+  int ret;
+
+  if (tjpf < 0) {
+    GST_ERROR_OBJECT (dec, "Unsupported RGB format: %s",
+        gst_video_format_to_string (format));
+    return GST_FLOW_ERROR;
+  }
+
+  /* Basic validation - ensure buffer has reasonable size */
+  if (!dest || stride <= 0) {
+    GST_ERROR_OBJECT (dec, "Invalid output buffer: dest=%p, stride=%d", dest, stride);
+    return GST_FLOW_ERROR;
+  }
+
+  /* Validate input buffer */
+  if (!map_info->data || map_info->size == 0) {
+    GST_ERROR_OBJECT (dec, "Invalid input buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  GST_LOG_OBJECT (dec, "Decoding RGB: %dx%d, stride=%d, format=%s, tjpf=%d",
+      width, height, stride, gst_video_format_to_string (format), tjpf);
+
+  ret = tj3Decompress8 (handle, map_info->data, map_info->size,
+      dest, stride, tjpf);
+
+  if (ret < 0) {
+    GST_ERROR_OBJECT (dec, "TurboJPEG decompression failed: %s",
+        tj3GetErrorStr (handle));
+    return GST_FLOW_ERROR;
+  }
+
+  return GST_FLOW_OK;
+}
+
+/* Whether TurboJPEG's MCU-padded planes can be written straight into the
+ * frame: either the pool padded it or the frame size needs no padding */
+static gboolean
+gst_turbojpegdec_planes_fit (GstVideoFrame * frame,
+    const GstTurboJpegDecParams * params, const gint strides[3])
+{
+  gint c;
+
+  if (params->padded)
+    return TRUE;
+
+  for (c = 0; c < 3; c++) {
+    if (tj3YUVPlaneWidth (c, params->width, params->subsamp) > strides[c] ||
+        tj3YUVPlaneHeight (c, params->height, params->subsamp) >
+        GST_VIDEO_FRAME_COMP_HEIGHT (frame, c))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Y, U, V plane pointers of a planar YUV frame, in TurboJPEG order */
+static void
+gst_turbojpegdec_get_yuv_planes (GstVideoFrame * frame, guint8 * planes[3],
+    gint strides[3])
+{
+  planes[0] = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+  strides[0] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+
+  if (GST_VIDEO_FRAME_FORMAT (frame) == GST_VIDEO_FORMAT_YV12) {
+    /* YV12 has V and U planes swapped */
+    planes[1] = GST_VIDEO_FRAME_PLANE_DATA (frame, 2);  /* V plane */
+    planes[2] = GST_VIDEO_FRAME_PLANE_DATA (frame, 1);  /* U plane */
+    strides[1] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 2);
+    strides[2] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 1);
+  } else {
+    /* I420, Y42B, Y444 */
+    planes[1] = GST_VIDEO_FRAME_PLANE_DATA (frame, 1);  /* U plane */
+    planes[2] = GST_VIDEO_FRAME_PLANE_DATA (frame, 2);  /* V plane */
+    strides[1] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 1);
+    strides[2] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 2);
+  }
+}
+
+static GstFlowReturn
+gst_turbojpegdec_decode_yuv (GstTurboJpegDec * dec, tjhandle handle,
+    GstMapInfo * map_info, GstVideoFrame * frame,
+    const GstTurboJpegDecParams * params)
+{
+  gint width = params->width;
+  gint height = params->height;
+  gint subsamp = params->subsamp;
+  guint8 *planes[3], *tj_planes[3];
+  gint strides[3], tj_strides[3], tj_heights[3];
+  GstTurboJpegChromaPlan chroma;
+  gint chroma_width;
+  gboolean luma_in_place;
+  guint8 *scratch, *rows;
+  gint c, y;
+
+  GST_LOG_OBJECT (dec, "Decoding YUV: %dx%d, subsampling: %d, format: %s",
+      width, height, subsamp,
+      gst_video_format_to_string (GST_VIDEO_FRAME_FORMAT (frame)));
+
+  gst_turbojpegdec_get_yuv_planes (frame, planes, strides);
+
+  if (!params->convert && gst_turbojpegdec_planes_fit (frame, params,
+          strides)) {
+    if (tj3DecompressToYUVPlanes8 (handle, map_info->data, map_info->size,
+            planes, strides) < 0) {
+      GST_ERROR_OBJECT (dec, "TurboJPEG YUV decompression failed: %s",
+          tj3GetErrorStr (handle));
+      return GST_FLOW_ERROR;
+    }
+    return GST_FLOW_OK;
+  }
+
+  if (subsamp == TJSAMP_GRAY) {
+    /* Only the luma plane exists, TurboJPEG ignores the chroma pointers */
+    if (tj3DecompressToYUVPlanes8 (handle, map_info->data, map_info->size,
+            planes, strides) < 0) {
+      GST_ERROR_OBJECT (dec, "TurboJPEG YUV decompression failed: %s",
+          tj3GetErrorStr (handle));
+      return GST_FLOW_ERROR;
+    }
+    for (c = 1; c < 3; c++) {
+      for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (frame, c); y++)
+        memset (planes[c] + (gsize) y * strides[c], 128,
+            GST_VIDEO_FRAME_COMP_WIDTH (frame, c));
+    }
+    return GST_FLOW_OK;
+  }
+
+  /* Matching planes whose MCU padding would overrun an unpadded frame are
+   * bounced through scratch and copied */
+  chroma = params->chroma;
+  if (!params->convert)
+    gst_turbojpeg_chroma_plan_init (&chroma, tjMCUWidth[subsamp] / 8,
+        tjMCUHeight[subsamp] / 8, tjMCUWidth[subsamp] / 8,
+        tjMCUHeight[subsamp] / 8);
+
+  if (!chroma.blend_row) {
+    GST_ERROR_OBJECT (dec, "Unsupported chroma conversion for subsampling %d",
+        subsamp);
+    return GST_FLOW_ERROR;
+  }
+
+  for (c = 0; c < 3; c++) {
+    tj_strides[c] = tj3YUVPlaneWidth (c, width, subsamp);
+    tj_heights[c] = tj3YUVPlaneHeight (c, height, subsamp);
+  }
+
+  /* Luma needs no resampling and is written straight into the frame when
+   * possible */
+  luma_in_place = gst_turbojpegdec_luma_in_place (strides[0], width, height,
+      subsamp);
+  chroma_width = MAX (GST_VIDEO_FRAME_COMP_WIDTH (frame, 1),
+      GST_VIDEO_FRAME_COMP_WIDTH (frame, 2));
+
+  /* Same size for every frame of the stream, so served from the arena */
+  scratch = gst_turbojpeg_arena_acquire (dec->arena,
+      gst_turbojpegdec_scratch_size (width, height, subsamp, chroma_width,
+          luma_in_place));
+  tj_planes[1] = scratch;
+  tj_planes[2] = tj_planes[1] + (gsize) tj_strides[1] * tj_heights[1];
+  rows = tj_planes[2] + (gsize) tj_strides[2] * tj_heights[2];
+  if (luma_in_place) {
+    tj_planes[0] = planes[0];
+    tj_strides[0] = strides[0];
+  } else {
+    tj_planes[0] = rows + gst_turbojpeg_chroma_scratch_size (chroma_width);
+  }
+
+  if (tj3DecompressToYUVPlanes8 (handle, map_info->data, map_info->size,
+          tj_planes, tj_strides) < 0) {
+    GST_ERROR_OBJECT (dec, "TurboJPEG YUV decompression failed: %s",
+        tj3GetErrorStr (handle));
+    gst_turbojpeg_arena_release (dec->arena, scratch);
+    return GST_FLOW_ERROR;
+  }
+
+  if (!luma_in_place) {
+    for (y = 0; y < height; y++)
+      memcpy (planes[0] + (gsize) y * strides[0],
+          tj_planes[0] + (gsize) y * tj_strides[0], width);
+  }
+
+  for (c = 1; c < 3; c++) {
+    gst_turbojpeg_chroma_resample (&chroma, tj_planes[c],
+        tj_strides[c], tj_strides[c], tj_heights[c], planes[c], strides[c],
+        GST_VIDEO_FRAME_COMP_WIDTH (frame, c),
+        GST_VIDEO_FRAME_COMP_HEIGHT (frame, c), rows);
+  }
+
+  gst_turbojpeg_arena_release (dec->arena, scratch);
+
+  return GST_FLOW_OK;
+}
+
+/* Resample and emit output rows @y to @y + @height of a semi-planar or
+ * packed YUV frame, STRIP_ROWS chroma rows at a time. @tj_planes hold the
+ * same rows at JPEG subsampling */
+static void
+gst_turbojpegdec_emit_strips (GstVideoFrame * frame,
+    const GstTurboJpegDecParams * params, gint y, gint height,
+    guint8 * tj_planes[3], const gint tj_strides[3], const gint tj_heights[3],
+    guint8 * strip[2], guint8 * rows)
+{
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (frame);
+  gboolean packed = gst_turbojpegdec_is_packed_yuv_format (format);
+  gint chroma_w = GST_VIDEO_FRAME_COMP_WIDTH (frame, 1);
+  gint v_sub = GST_VIDEO_FORMAT_INFO_H_SUB (frame->info.finfo, 1);
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, packed ? 0 : 1);
+  guint8 *dst = GST_VIDEO_FRAME_PLANE_DATA (frame, packed ? 0 : 1);
+  const guint8 *u, *v;
+  gint first, n_rows, r, n, i, c;
+
+  /* Parts start on a chroma row, so their chroma rows do not overlap */
+  first = y >> v_sub;
+  n_rows = MIN ((y + height + v_sub) >> v_sub,
+      GST_VIDEO_FRAME_COMP_HEIGHT (frame, 1)) - first;
+  c = format == GST_VIDEO_FORMAT_NV21 ? 1 : 0;
+
+  for (r = 0; r < n_rows; r += STRIP_ROWS) {
+    gint u_stride = tj_strides[1 + c];
+    gint v_stride = tj_strides[2 - c];
+
+    n = MIN (STRIP_ROWS, n_rows - r);
+    u = tj_planes[1 + c] + (gsize) r * u_stride;
+    v = tj_planes[2 - c] + (gsize) r * v_stride;
+    if (params->convert) {
+      gst_turbojpeg_chroma_resample_rows (&params->chroma, tj_planes[1 + c],
+          u_stride, u_stride, tj_heights[1 + c], strip[0], chroma_w,
+          chroma_w, r, n, rows);
+      gst_turbojpeg_chroma_resample_rows (&params->chroma, tj_planes[2 - c],
+          v_stride, v_stride, tj_heights[2 - c], strip[1], chroma_w,
+          chroma_w, r, n, rows);
+      u = strip[0];
+      v = strip[1];
+      u_stride = v_stride = chroma_w;
+    }
+
+    for (i = 0; i < n; i++) {
+      guint8 *out = dst + (gsize) (first + r + i) * stride;
+
+      if (packed)
+        gst_turbojpeg_pack_422_row (out, tj_planes[0] + (gsize) (r + i) *
+            tj_strides[0], u + (gsize) i * u_stride, v + (gsize) i * v_stride,
+            params->width, format == GST_VIDEO_FORMAT_UYVY);
+      else
+        gst_turbojpeg_interleave_row (out, u + (gsize) i * u_stride,
+            v + (gsize) i * v_stride, chroma_w);
+    }
+  }
+}
+
+/* Scratch for a part @height rows high: TurboJPEG's planes, the resampler
+ * rows and one strip of each resampled chroma plane */
+static gsize
+gst_turbojpegdec_strip_scratch_size (gint width, gint height, gint subsamp,
+    gint chroma_width, gboolean luma_in_place)
+{
+  return gst_turbojpegdec_scratch_size (width, height, subsamp, chroma_width,
+      luma_in_place) + 2 * (gsize) STRIP_ROWS * chroma_width;
+}
+
+/* Decode the JPEG in @data, covering output rows @y to @y + @height, into
+ * a semi-planar or packed frame. Semi-planar luma goes straight to the
+ * frame where the padding allows; everything else only ever exists in
+ * @scratch, sized by gst_turbojpegdec_strip_scratch_size() */
+static gboolean
+gst_turbojpegdec_decode_part (GstTurboJpegDec * dec, tjhandle handle,
+    const guint8 * data, gsize size, GstVideoFrame * frame,
+    const GstTurboJpegDecParams * params, gint y, gint height,
+    guint8 * scratch)
+{
+  gint width = params->width;
+  gint subsamp = params->subsamp;
+  gint chroma_w = GST_VIDEO_FRAME_COMP_WIDTH (frame, 1);
+  gint y_stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+  guint8 *y_plane = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+  guint8 *tj_planes[3], *rows, *strip[2];
+  gint tj_strides[3], tj_heights[3];
+  gboolean luma_in_place, luma_direct;
+  gint r, c;
+
+  for (c = 0; c < 3; c++) {
+    tj_strides[c] = tj3YUVPlaneWidth (c, width, subsamp);
+    tj_heights[c] = tj3YUVPlaneHeight (c, height, subsamp);
+  }
+
+  luma_direct = gst_turbojpegdec_is_nv_format (GST_VIDEO_FRAME_FORMAT
+      (frame));
+  luma_in_place = luma_direct &&
+      gst_turbojpegdec_luma_in_place (y_stride, width, height, subsamp);
+  tj_planes[1] = scratch;
+  tj_planes[2] = tj_planes[1] + (gsize) tj_strides[1] * tj_heights[1];
+  rows = tj_planes[2] + (gsize) tj_strides[2] * tj_heights[2];
+  strip[0] = rows + gst_turbojpeg_chroma_scratch_size (chroma_w);
+  strip[1] = strip[0] + (gsize) STRIP_ROWS * chroma_w;
+  if (luma_in_place) {
+    tj_planes[0] = y_plane + (gsize) y * y_stride;
+    tj_strides[0] = y_stride;
+  } else {
+    tj_planes[0] = strip[1] + (gsize) STRIP_ROWS * chroma_w;
+  }
+
+  if (tj3DecompressToYUVPlanes8 (handle, data, size, tj_planes,
+          tj_strides) < 0) {
+    GST_ERROR_OBJECT (dec, "TurboJPEG YUV decompression failed: %s",
+        tj3GetErrorStr (handle));
+    return FALSE;
+  }
+
+  if (luma_direct && !luma_in_place) {
+    for (r = 0; r < height; r++)
+      memcpy (y_plane + (gsize) (y + r) * y_stride,
+          tj_planes[0] + (gsize) r * tj_strides[0], width);
+  }
+
+  gst_turbojpegdec_emit_strips (frame, params, y, height, tj_planes,
+      tj_strides, tj_heights, strip, rows);
+
+  return TRUE;
+}
+
+/* libjpeg's fancy upsampling reads the chroma rows above and below each
+ * row, which a band decoded on its own replicates from its edges instead.
+ * Packed pixels only match a whole-frame decode at band seams when chroma
+ * is not subsampled vertically */
+static gboolean
+gst_turbojpegdec_packed_bands_exact (gint subsamp)
+{
+  return subsamp == TJSAMP_444 || subsamp == TJSAMP_422 ||
+      subsamp == TJSAMP_GRAY;
+}
+
+/* Split the JPEG at restart markers into bands of about BAND_ROWS output
+ * rows. Returns the number of bands, or 0 if the frame has to be decoded
+ * whole. Band JPEGs are written to @storage */
+static gint
+gst_turbojpegdec_strip_bands (GstTurboJpegDec * dec, GstMapInfo * map_info,
+    GstVideoFrame * frame, const GstTurboJpegDecParams * params,
+    GByteArray * storage, GstTurboJpegBand * bands)
+{
+  GstTurboJpegScanInfo info;
+  gint v_sub = GST_VIDEO_FORMAT_INFO_H_SUB (frame->info.finfo, 1);
+  gint n_bands, b;
+
+  /* Vertical upsampling reads chroma rows across band edges */
+  if (params->convert && params->chroma.v_op != GST_TURBOJPEG_RESAMPLE_COPY
+      && params->chroma.v_op != GST_TURBOJPEG_RESAMPLE_DOWN2)
+    return 0;
+
+  if (!gst_turbojpeg_scan_headers (map_info->data, map_info->size, &info))
+    return 0;
+
+  n_bands = gst_turbojpeg_split_restart_bands (map_info->data,
+      map_info->size, &info, MAX (params->height / BAND_ROWS, 1), storage,
+      bands);
+  if (n_bands < 2)
+    return 0;
+
+  /* Every band has to start on an output chroma row */
+  for (b = 0; b < n_bands; b++) {
+    bands[b].y = bands[b].y * params->scale.num / params->scale.denom;
+    bands[b].height = TJSCALED (bands[b].height, params->scale);
+    if (bands[b].y & v_sub)
+      return 0;
+  }
+
+  return n_bands;
+}
+
+/* Grayscale JPEG to YUY2/UYVY, packed with neutral chroma */
+static GstFlowReturn
+gst_turbojpegdec_decode_gray_packed (GstTurboJpegDec * dec, tjhandle handle,
+    GstMapInfo * map_info, GstVideoFrame * frame)
+{
+  gint width = GST_VIDEO_FRAME_WIDTH (frame);
+  gint height = GST_VIDEO_FRAME_HEIGHT (frame);
+  gint chroma_w = GST_VIDEO_FRAME_COMP_WIDTH (frame, 1);
+  guint8 *scratch, *neutral, *planes[3];
+  gint strides[3];
+  gint r;
+
+  scratch = gst_turbojpeg_arena_acquire (dec->arena,
+      (gsize) width * height + chroma_w);
+  neutral = scratch + (gsize) width * height;
+  memset (neutral, 128, chroma_w);
+
+  planes[0] = planes[1] = planes[2] = scratch;
+  strides[0] = strides[1] = strides[2] = width;
+  if (tj3DecompressToYUVPlanes8 (handle, map_info->data, map_info->size,
+          planes, strides) < 0) {
+    GST_ERROR_OBJECT (dec, "TurboJPEG YUV decompression failed: %s",
+        tj3GetErrorStr (handle));
+    gst_turbojpeg_arena_release (dec->arena, scratch);
+    return GST_FLOW_ERROR;
+  }
+
+  for (r = 0; r < height; r++)
+    gst_turbojpeg_pack_422_row ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (frame,
+            0) + (gsize) r * GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0),
+        scratch + (gsize) r * width, neutral, neutral, width,
+        GST_VIDEO_FRAME_FORMAT (frame) == GST_VIDEO_FORMAT_UYVY);
+
+  gst_turbojpeg_arena_release (dec->arena, scratch);
+
+  return GST_FLOW_OK;
+}
+
+/* NV12/NV21, YUY2 and UYVY output. TurboJPEG only produces separate
+ * planes, so they are decoded band by band when the JPEG has restart
+ * markers and then resampled, interleaved or packed strip by strip. Without
+ * restart markers the planes of the whole frame go through scratch once */
+static GstFlowReturn
+gst_turbojpegdec_decode_strips (GstTurboJpegDec * dec, tjhandle handle,
+    GstMapInfo * map_info, GstVideoFrame * frame,
+    const GstTurboJpegDecParams * params)
+{
+  GstTurboJpegBand bands[GST_TURBOJPEG_MAX_BANDS];
+  GByteArray *storage;
+  gint chroma_w = GST_VIDEO_FRAME_COMP_WIDTH (frame, 1);
+  gint y_stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+  gint n_bands, b, max_height, r;
+  gboolean luma_in_place;
+  gboolean ok = TRUE;
+  guint8 *scratch, *planes[3];
+  gint strides[3];
+  gsize size;
+
+  GST_LOG_OBJECT (dec, "Decoding in strips: %dx%d, subsampling: %d, "
+      "format: %s", params->width, params->height, params->subsamp,
+      gst_video_format_to_string (GST_VIDEO_FRAME_FORMAT (frame)));
+
+  if (params->subsamp == TJSAMP_GRAY &&
+      gst_turbojpegdec_is_nv_format (GST_VIDEO_FRAME_FORMAT (frame))) {
+    /* Only the luma plane exists, TurboJPEG ignores the chroma pointers */
+    planes[0] = planes[1] = planes[2] = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+    strides[0] = strides[1] = strides[2] = y_stride;
+    if (tj3DecompressToYUVPlanes8 (handle, map_info->data, map_info->size,
+            planes, strides) < 0) {
+      GST_ERROR_OBJECT (dec, "TurboJPEG YUV decompression failed: %s",
+          tj3GetErrorStr (handle));
+      return GST_FLOW_ERROR;
+    }
+    for (r = 0; r < GST_VIDEO_FRAME_COMP_HEIGHT (frame, 1); r++)
+      memset ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (frame, 1) +
+          (gsize) r * GST_VIDEO_FRAME_PLANE_STRIDE (frame, 1), 128,
+          2 * chroma_w);
+    return GST_FLOW_OK;
+  }
+
+  if (params->subsamp == TJSAMP_GRAY)
+    return gst_turbojpegdec_decode_gray_packed (dec, handle, map_info, frame);
+
+  if (params->convert && !params->chroma.blend_row) {
+    GST_ERROR_OBJECT (dec, "Unsupported chroma conversion for subsampling %d",
+        params->subsamp);
+    return GST_FLOW_ERROR;
+  }
+
+  /* Called from worker threads too, so the band JPEGs get their own
+   * storage */
+  storage = g_byte_array_new ();
+  n_bands = gst_turbojpegdec_strip_bands (dec, map_info, frame, params,
+      storage, bands);
+  if (n_bands == 0) {
+    bands[0].offset = 0;
+    bands[0].size = map_info->size;
+    bands[0].y = 0;
+    bands[0].height = params->height;
+    n_bands = 1;
+  }
+
+  max_height = 0;
+  luma_in_place =
+      gst_turbojpegdec_is_nv_format (GST_VIDEO_FRAME_FORMAT (frame));
+  for (b = 0; b < n_bands; b++) {
+    max_height = MAX (max_height, bands[b].height);
+    luma_in_place &= gst_turbojpegdec_luma_in_place (y_stride, params->width,
+        bands[b].height, params->subsamp);
+  }
+
+  size = gst_turbojpegdec_strip_scratch_size (params->width, max_height,
+      params->subsamp, chroma_w, luma_in_place);
+  scratch = gst_turbojpeg_arena_acquire (dec->arena, size);
+
+  GST_LOG_OBJECT (dec, "Decoding in %d band(s) of up to %d rows", n_bands,
+      max_height);
+
+  for (b = 0; b < n_bands && ok; b++) {
+    const guint8 *data = n_bands > 1 ?
+        storage->data + bands[b].offset : map_info->data;
+
+    ok = gst_turbojpegdec_decode_part (dec, handle, data, bands[b].size,
+        frame, params, bands[b].y, bands[b].height, scratch);
+  }
+
+  gst_turbojpeg_arena_release (dec->arena, scratch);
+  g_byte_array_unref (storage);
+
+  return ok ? GST_FLOW_OK : GST_FLOW_ERROR;
+}
+
+/* Planar RGB output. TurboJPEG only produces packed RGB, so the frame is
+ * decoded band by band when the JPEG has restart markers and no vertical
+ * chroma subsampling, and each band is split into the planes while it is
+ * still in cache. Otherwise the whole frame goes through packed scratch
+ * once */
+static GstFlowReturn
+gst_turbojpegdec_decode_planar_rgb (GstTurboJpegDec * dec, tjhandle handle,
+    GstMapInfo * map_info, GstVideoFrame * frame,
+    const GstTurboJpegDecParams * params)
+{
+  GstTurboJpegBand bands[GST_TURBOJPEG_MAX_BANDS];
+  GByteArray *storage;
+  gint width = params->width;
+  gint n_bands, b, r, max_height;
+  guint8 *scratch, *planes[3];
+  gint strides[3];
+  gboolean ok = TRUE;
+
+  for (r = 0; r < 3; r++) {
+    planes[r] = GST_VIDEO_FRAME_COMP_DATA (frame, GST_VIDEO_COMP_R + r);
+    strides[r] = GST_VIDEO_FRAME_COMP_STRIDE (frame, GST_VIDEO_COMP_R + r);
+  }
+
+  /* The instance may still hold the cropping region of a packed decode */
+  if (tj3SetCroppingRegion (handle, TJUNCROPPED) < 0) {
+    GST_ERROR_OBJECT (dec, "Failed to reset cropping region: %s",
+        tj3GetErrorStr (handle));
+    return GST_FLOW_ERROR;
+  }
+
+  /* Called from worker threads too, so the band JPEGs get their own
+   * storage */
+  storage = g_byte_array_new ();
+  n_bands = 0;
+  if (gst_turbojpegdec_packed_bands_exact (params->subsamp))
+    n_bands = gst_turbojpegdec_strip_bands (dec, map_info, frame, params,
+        storage, bands);
+  if (n_bands == 0) {
+    bands[0].offset = 0;
+    bands[0].size = map_info->size;
+    bands[0].y = 0;
+    bands[0].height = params->height;
+    n_bands = 1;
+  }
+
+  max_height = 0;
+  for (b = 0; b < n_bands; b++)
+    max_height = MAX (max_height, bands[b].height);
+
+  GST_LOG_OBJECT (dec, "Decoding planar RGB: %dx%d in %d band(s)", width,
+      params->height, n_bands);
+
+  scratch = gst_turbojpeg_arena_acquire (dec->arena,
+      (gsize) width * 3 * max_height);
+
+  for (b = 0; b < n_bands && ok; b++) {
+    const guint8 *data = n_bands > 1 ?
+        storage->data + bands[b].offset : map_info->data;
+
+    if (tj3Decompress8 (handle, data, bands[b].size, scratch, width * 3,
+            TJPF_RGB) < 0) {
+      GST_ERROR_OBJECT (dec, "TurboJPEG decompression failed: %s",
+          tj3GetErrorStr (handle));
+      ok = FALSE;
+      break;
+    }
+
+    for (r = 0; r < bands[b].height; r++) {
+      gsize y = bands[b].y + r;
+
+      gst_turbojpeg_deinterleave3_row (planes[0] + y * strides[0],
+          planes[1] + y * strides[1], planes[2] + y * strides[2],
+          scratch + (gsize) r * width * 3, width);
+    }
+  }
+
+  gst_turbojpeg_arena_release (dec->arena, scratch);
+  g_byte_array_unref (storage);
+
+  return ok ? GST_FLOW_OK : GST_FLOW_ERROR;
+}
+
+/* Restrict a packed decode to the region of interest, so that nothing
+ * outside it is run through the IDCT or colour conversion. TurboJPEG checks
+ * the region against the header, which has to be read on @handle first */
+static gboolean
+gst_turbojpegdec_set_cropping (GstTurboJpegDec * dec, tjhandle handle,
+    GstMapInfo * map_info, const GstTurboJpegDecParams * params)
+{
+  tjregion scaled = TJUNCROPPED;
+
+  if (params->region.w) {
+    if (tj3DecompressHeader (handle, map_info->data, map_info->size) < 0)
+      goto error;
+    scaled.x = params->region.x * params->scale.num / params->scale.denom;
+    scaled.y = params->region.y * params->scale.num / params->scale.denom;
+    scaled.w = TJSCALED (params->region.w, params->scale);
+    scaled.h = TJSCALED (params->region.h, params->scale);
+  }
+
+  if (tj3SetCroppingRegion (handle, scaled) < 0)
+    goto error;
+
+  return TRUE;
+
+error:
+  GST_ERROR_OBJECT (dec, "Failed to set cropping region: %s",
+      tj3GetErrorStr (handle));
+  return FALSE;
+}
+
+/* Decode a JPEG with more than 8 bits per sample into GRAY16 or ARGB64,
+ * then stretch the samples to the full 16-bit range */
+static GstFlowReturn
+gst_turbojpegdec_decode_16 (GstTurboJpegDec * dec, tjhandle handle,
+    GstMapInfo * map_info, GstVideoFrame * frame,
+    const GstTurboJpegDecParams * params)
+{
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (frame);
+  int tjpf = gst_turbojpegdec_get_tjpf16_from_format (format);
+  guint8 *dest = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+  gint width = GST_VIDEO_FRAME_WIDTH (frame);
+  gint height = GST_VIDEO_FRAME_HEIGHT (frame);
+  gint y, ret;
+
+  if (tjpf < 0) {
+    GST_ERROR_OBJECT (dec, "Unsupported format for %d-bit JPEG: %s",
+        params->precision, gst_video_format_to_string (format));
     return GST_FLOW_ERROR;
   }
 
-  if (tj3DecompressHeader (dec->tjInstanceHeader, map_info.data, map_info.size) < 0) {
+  GST_LOG_OBJECT (dec, "Decoding %d-bit: %dx%d, stride=%d, format=%s",
+      params->precision, width, height, stride,
+      gst_video_format_to_string (format));
+
+  /* The 12 and 16-bit functions take the pitch in samples */
+  if (params->precision <= 12)
+    ret = tj3Decompress12 (handle, map_info->data, map_info->size,
+        (short *) dest, stride / 2, tjpf);
+  else
+    ret = tj3Decompress16 (handle, map_info->data, map_info->size,
+        (unsigned short *) dest, stride / 2, tjpf);
+
+  if (ret < 0) {
+    GST_ERROR_OBJECT (dec, "TurboJPEG %d-bit decompression failed: %s",
+        params->precision, tj3GetErrorStr (handle));
+    return GST_FLOW_ERROR;
+  }
+
+  for (y = 0; y < height; y++)
+    gst_turbojpeg_expand_samples_row ((guint16 *) (dest + (gsize) y * stride),
+        width * tjPixelSize[tjpf], params->precision);
+
+  return GST_FLOW_OK;
+}
+
+/* Decode one JPEG into a mapped output frame using the given instance.
+ * Safe to call from worker threads: only @params and @handle are used */
+static GstFlowReturn
+gst_turbojpegdec_decode (GstTurboJpegDec * dec, tjhandle handle,
+    GstMapInfo * map_info, GstVideoFrame * frame,
+    const GstTurboJpegDecParams * params)
+{
+  /* Instances are shared between streams of differently scaled frames */
+  if (tj3SetScalingFactor (handle, params->scale) < 0) {
+    GST_ERROR_OBJECT (dec, "Failed to set scaling factor %d/%d: %s",
+        params->scale.num, params->scale.denom, tj3GetErrorStr (handle));
+    return GST_FLOW_ERROR;
+  }
+
+  if (gst_turbojpegdec_is_yuv_format (GST_VIDEO_FRAME_FORMAT (frame)))
+    return gst_turbojpegdec_decode_yuv (dec, handle, map_info, frame,
+        params);
+
+  if (gst_turbojpegdec_is_nv_format (GST_VIDEO_FRAME_FORMAT (frame)) ||
+      gst_turbojpegdec_is_packed_yuv_format (GST_VIDEO_FRAME_FORMAT (frame)))
+    return gst_turbojpegdec_decode_strips (dec, handle, map_info, frame,
+        params);
+
+  if (gst_turbojpegdec_is_planar_rgb_format (GST_VIDEO_FRAME_FORMAT (frame)))
+    return gst_turbojpegdec_decode_planar_rgb (dec, handle, map_info, frame,
+        params);
+
+  if (!gst_turbojpegdec_set_cropping (dec, handle, map_info, params))
+    return GST_FLOW_ERROR;
+
+  if (params->precision > 8)
+    return gst_turbojpegdec_decode_16 (dec, handle, map_info, frame, params);
+
+  return gst_turbojpegdec_decode_rgb (dec, handle, map_info, frame);
+}
+
+/* One band of a frame split at restart markers */
+typedef struct
+{
+  const guint8 *data;
+  gsize size;
+  gint tjpf;                  /* Packed pixel format, -1 for planar YUV */
+  tjscalingfactor scale;
+  guint8 *planes[3];
+  gint strides[3];
+  gint ret;
+  gint *remaining;
+} GstTurboJpegDecSlice;
+
+static void
+gst_turbojpegdec_decode_slice (GstTurboJpegDec * dec, tjhandle handle,
+    GstTurboJpegDecSlice * slice)
+{
+  if (tj3SetScalingFactor (handle, slice->scale) < 0 ||
+      tj3SetCroppingRegion (handle, TJUNCROPPED) < 0)
+    slice->ret = -1;
+  else if (slice->tjpf < 0)
+    slice->ret = tj3DecompressToYUVPlanes8 (handle, slice->data, slice->size,
+        slice->planes, slice->strides);
+  else
+    slice->ret = tj3Decompress8 (handle, slice->data, slice->size,
+        slice->planes[0], slice->strides[0], slice->tjpf);
+
+  if (slice->ret < 0)
+    GST_ERROR_OBJECT (dec, "TurboJPEG slice decompression failed: %s",
+        tj3GetErrorStr (handle));
+}
+
+static void
+gst_turbojpegdec_slice_func (gpointer data, gpointer user_data)
+{
+  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (user_data);
+  GstTurboJpegDecSlice *slice = data;
+  tjhandle handle;
+
+  handle = g_async_queue_pop (dec->slice_handles);
+  gst_turbojpegdec_decode_slice (dec, handle, slice);
+  g_async_queue_push (dec->slice_handles, handle);
+
+  g_mutex_lock (&dec->lock);
+  (*slice->remaining)--;
+  g_cond_broadcast (&dec->cond);
+  g_mutex_unlock (&dec->lock);
+}
+
+/* Decode a frame as independent row bands when its restart markers allow
+ * it and TurboJPEG can write straight into the output planes. Returns FALSE
+ * if the frame has to take the regular path */
+static gboolean
+gst_turbojpegdec_decode_slices (GstTurboJpegDec * dec, GstMapInfo * map_info,
+    GstVideoFrame * frame, const GstTurboJpegDecParams * params,
+    GstFlowReturn * ret)
+{
+  GstTurboJpegScanInfo info;
+  GstTurboJpegBand bands[GST_TURBOJPEG_MAX_BANDS];
+  GstTurboJpegDecSlice slices[GST_TURBOJPEG_MAX_BANDS];
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (frame);
+  guint8 *planes[3];
+  gint strides[3];
+  gint tjpf = -1;
+  gint n_bands, remaining, b, c, y;
+  tjhandle handle;
+
+  if (gst_turbojpegdec_is_yuv_format (format)) {
+    if (params->convert)
+      return FALSE;
+    gst_turbojpegdec_get_yuv_planes (frame, planes, strides);
+    if (!gst_turbojpegdec_planes_fit (frame, params, strides))
+      return FALSE;
+    handle = dec->tjInstanceYUV;
+  } else {
+    /* Bands of a cropped frame would need cropping themselves */
+    tjpf = gst_turbojpegdec_get_tjpf_from_format (format);
+    if (tjpf < 0 || params->region.w ||
+        !gst_turbojpegdec_packed_bands_exact (params->subsamp))
+      return FALSE;
+    planes[0] = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+    strides[0] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+    handle = dec->tjInstanceRGB;
+  }
+
+  if (!gst_turbojpeg_scan_headers (map_info->data, map_info->size, &info))
+    return FALSE;
+
+  n_bands = gst_turbojpeg_split_restart_bands (map_info->data,
+      map_info->size, &info, g_thread_pool_get_max_threads (dec->slice_pool)
+      + 1, dec->slice_storage, bands);
+  if (n_bands < 2)
+    return FALSE;
+
+  GST_LOG_OBJECT (dec, "Decoding %d restart-marker slices", n_bands);
+
+  for (b = 0; b < n_bands; b++) {
+    GstTurboJpegDecSlice *slice = &slices[b];
+
+    slice->data = dec->slice_storage->data + bands[b].offset;
+    slice->size = bands[b].size;
+    slice->tjpf = tjpf;
+    slice->scale = params->scale;
+    slice->ret = 0;
+    slice->remaining = &remaining;
+
+    /* Bands start on multiples of 8 rows, which every factor scales
+     * exactly */
+    y = bands[b].y * params->scale.num / params->scale.denom;
+
+    if (tjpf < 0) {
+      /* Bands start on MCU rows, so chroma rows divide exactly */
+      for (c = 0; c < 3; c++) {
+        gint rows = c == 0 ? y : y / (tjMCUHeight[params->subsamp] / 8);
+
+        slice->planes[c] = planes[c] + (gsize) strides[c] * rows;
+        slice->strides[c] = strides[c];
+      }
+    } else {
+      slice->planes[0] = planes[0] + (gsize) strides[0] * y;
+      slice->strides[0] = strides[0];
+    }
+  }
+
+  remaining = n_bands - 1;
+  for (b = 1; b < n_bands; b++)
+    g_thread_pool_push (dec->slice_pool, &slices[b], NULL);
+
+  gst_turbojpegdec_decode_slice (dec, handle, &slices[0]);
+
+  g_mutex_lock (&dec->lock);
+  while (remaining > 0)
+    g_cond_wait (&dec->cond, &dec->lock);
+  g_mutex_unlock (&dec->lock);
+
+  *ret = GST_FLOW_OK;
+  for (b = 0; b < n_bands; b++) {
+    if (slices[b].ret < 0)
+      *ret = GST_FLOW_ERROR;
+  }
+
+  return TRUE;
+}
+
+/* Replace the input of @frame by a lossless crop of it to @region. Only
+ * the entropy-coded data inside the region is re-encoded; nothing is
+ * run through the IDCT */
+static GstFlowReturn
+gst_turbojpegdec_crop_input (GstTurboJpegDec * dec, GstVideoCodecFrame * frame,
+    GstMapInfo * map_info, const tjregion * region)
+{
+  tjtransform xform;
+  guint8 *data = NULL;
+  size_t size = 0;
+  GstBuffer *cropped;
+  GstMapInfo cropped_map;
+
+  if (!dec->tjInstanceTransform) {
+    dec->tjInstanceTransform = tj3Init (TJINIT_TRANSFORM);
+    if (!dec->tjInstanceTransform) {
+      GST_ERROR_OBJECT (dec, "Failed to initialize TurboJPEG transform "
+          "instance");
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  memset (&xform, 0, sizeof (xform));
+  xform.r = *region;
+  xform.op = TJXOP_NONE;
+  xform.options = TJXOPT_CROP;
+
+  if (tj3Transform (dec->tjInstanceTransform, map_info->data, map_info->size,
+          1, &data, &size, &xform) < 0) {
+    GST_ERROR_OBJECT (dec, "Failed to crop JPEG: %s",
+        tj3GetErrorStr (dec->tjInstanceTransform));
+    tj3Free (data);
+    return GST_FLOW_ERROR;
+  }
+
+  cropped = gst_buffer_new_wrapped_full (0, data, size, 0, size, data,
+      (GDestroyNotify) tj3Free);
+  if (!gst_buffer_map (cropped, &cropped_map, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (dec, "Failed to map cropped JPEG");
+    gst_buffer_unref (cropped);
+    return GST_FLOW_ERROR;
+  }
+
+  /* Keep timestamps, flags and metas for the output buffer */
+  gst_buffer_copy_into (cropped, frame->input_buffer,
+      GST_BUFFER_COPY_METADATA, 0, -1);
+
+  gst_buffer_unmap (frame->input_buffer, map_info);
+  gst_buffer_unref (frame->input_buffer);
+  frame->input_buffer = cropped;
+  *map_info = cropped_map;
+
+  return GST_FLOW_OK;
+}
+
+/* Push a decoded frame downstream, or account for a failed decode */
+static GstFlowReturn
+gst_turbojpegdec_push_decoded (GstTurboJpegDec * dec,
+    GstVideoCodecFrame * frame, GstFlowReturn ret)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (dec);
+
+  if (ret == GST_FLOW_OK) {
+    const GstTurboJpegCacheKey *key = gst_video_codec_frame_get_user_data
+        (frame);
+
+    dec->error_count = 0;
+    if (key)
+      gst_turbojpeg_cache_insert (dec->cache, key, frame->output_buffer);
+    if (dec->dup_valid && frame->system_frame_number == dec->dup_frame)
+      gst_buffer_replace (&dec->dup_output, frame->output_buffer);
+    return gst_video_decoder_finish_frame (decoder, frame);
+  }
+
+  dec->error_count++;
+  if (dec->error_count >= dec->max_errors) {
+    GST_ELEMENT_ERROR (dec, STREAM, DECODE, 
+        ("Too many decode errors"), 
+        ("Error count reached maximum of %d", dec->max_errors));
+  }
+  gst_video_decoder_drop_frame (decoder, frame);
+  return ret;
+}
+
+static void
+gst_turbojpegdec_worker_func (gpointer data, gpointer user_data)
+{
+  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (user_data);
+  GstTurboJpegDecJob *job = data;
+  tjhandle handle;
+
+  handle = g_async_queue_pop (dec->handles);
+  job->ret = gst_turbojpegdec_decode (dec, handle, &job->map_info,
+      &job->video_frame, &job->params);
+  g_async_queue_push (dec->handles, handle);
+
+  g_mutex_lock (&dec->lock);
+  job->done = TRUE;
+  g_cond_broadcast (&dec->cond);
+  g_mutex_unlock (&dec->lock);
+}
+
+/* Wait for the oldest in-flight job to complete and take it off the queue.
+ * Returns NULL once no more than @max_pending jobs remain and the oldest one
+ * is still being decoded. Called with the stream lock held */
+static GstTurboJpegDecJob *
+gst_turbojpegdec_pop_job (GstTurboJpegDec * dec, guint max_pending)
+{
+  GstTurboJpegDecJob *job = NULL;
+
+  g_mutex_lock (&dec->lock);
+  while (!g_queue_is_empty (&dec->pending)) {
+    GstTurboJpegDecJob *head = g_queue_peek_head (&dec->pending);
+
+    if (head->done) {
+      job = g_queue_pop_head (&dec->pending);
+      break;
+    }
+    if (g_queue_get_length (&dec->pending) <= max_pending)
+      break;
+    g_cond_wait (&dec->cond, &dec->lock);
+  }
+  g_mutex_unlock (&dec->lock);
+
+  return job;
+}
+
+/* Push a frame whose output buffer is already set or, for a repeated
+ * frame, with the output of the frame it repeats. It is dropped if that
+ * one failed to decode */
+static GstFlowReturn
+gst_turbojpegdec_push_reused (GstTurboJpegDec * dec,
+    GstVideoCodecFrame * frame)
+{
+  if (!frame->output_buffer) {
+    if (!dec->dup_output)
+      return gst_video_decoder_drop_frame (GST_VIDEO_DECODER (dec), frame);
+
+    /* A shallow copy shares the decoded memory and keeps the crop meta */
+    frame->output_buffer = gst_buffer_copy (dec->dup_output);
+  }
+
+  return gst_turbojpegdec_push_decoded (dec, frame, GST_FLOW_OK);
+}
+
+static void
+gst_turbojpegdec_reset_duplicates (GstTurboJpegDec * dec)
+{
+  dec->dup_valid = FALSE;
+  gst_buffer_replace (&dec->dup_output, NULL);
+}
+
+static void
+gst_turbojpegdec_job_free (GstTurboJpegDec * dec, GstTurboJpegDecJob * job)
+{
+  if (!job->skipped && !job->reused) {
+    gst_video_frame_unmap (&job->video_frame);
+    gst_buffer_unmap (job->frame->input_buffer, &job->map_info);
+  }
+  g_slice_free (GstTurboJpegDecJob, job);
+}
+
+/* Push completed frames in decode order until at most @max_pending remain */
+static GstFlowReturn
+gst_turbojpegdec_push_completed (GstTurboJpegDec * dec, guint max_pending)
+{
+  GstTurboJpegDecJob *job;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  while ((job = gst_turbojpegdec_pop_job (dec, max_pending))) {
+    GstVideoCodecFrame *frame = job->frame;
+    GstFlowReturn job_ret = job->ret;
+    gboolean skipped = job->skipped;
+    gboolean reused = job->reused;
+    GstFlowReturn push_ret;
+
+    gst_turbojpegdec_job_free (dec, job);
+    if (skipped)
+      push_ret = gst_video_decoder_drop_frame (GST_VIDEO_DECODER (dec), frame);
+    else if (reused)
+      push_ret = gst_turbojpegdec_push_reused (dec, frame);
+    else
+      push_ret = gst_turbojpegdec_push_decoded (dec, frame, job_ret);
+
+    /* Keep the first failure, but still flush the remaining frames */
+    if (ret == GST_FLOW_OK)
+      ret = push_ret;
+  }
+
+  return ret;
+}
+
+/* Wait for all in-flight jobs and release their frames without pushing */
+static void
+gst_turbojpegdec_discard_pending (GstTurboJpegDec * dec)
+{
+  GstTurboJpegDecJob *job;
+
+  while ((job = gst_turbojpegdec_pop_job (dec, 0))) {
+    GstVideoCodecFrame *frame = job->frame;
+
+    gst_turbojpegdec_job_free (dec, job);
+    gst_video_decoder_release_frame (GST_VIDEO_DECODER (dec), frame);
+  }
+}
+
+static GstFlowReturn
+gst_turbojpegdec_submit_job (GstTurboJpegDec * dec, GstVideoCodecFrame * frame,
+    GstMapInfo * map_info, GstVideoFrame * video_frame,
+    const GstTurboJpegDecParams * params)
+{
+  GstTurboJpegDecJob *job = g_slice_new0 (GstTurboJpegDecJob);
+  GError *err = NULL;
+
+  job->frame = frame;
+  job->map_info = *map_info;
+  job->video_frame = *video_frame;
+  job->params = *params;
+  job->ret = GST_FLOW_ERROR;
+  job->done = FALSE;
+
+  g_mutex_lock (&dec->lock);
+  g_queue_push_tail (&dec->pending, job);
+  g_mutex_unlock (&dec->lock);
+
+  if (!g_thread_pool_push (dec->pool, job, &err)) {
+    GST_ERROR_OBJECT (dec, "Failed to queue frame: %s", err->message);
+    g_clear_error (&err);
+    g_mutex_lock (&dec->lock);
+    job->done = TRUE;
+    g_mutex_unlock (&dec->lock);
+  }
+
+  /* Keep every worker busy; block only once all of them are */
+  return gst_turbojpegdec_push_completed (dec,
+      g_thread_pool_get_max_threads (dec->pool) - 1);
+}
+
+/* Queue a frame that needs no decoding behind the frames workers are still
+ * decoding, so frames leave in order */
+static GstFlowReturn
+gst_turbojpegdec_queue_undecoded (GstTurboJpegDec * dec,
+    GstVideoCodecFrame * frame, gboolean reused)
+{
+  GstTurboJpegDecJob *job;
+
+  job = g_slice_new0 (GstTurboJpegDecJob);
+  job->frame = frame;
+  job->ret = GST_FLOW_OK;
+  job->done = TRUE;
+  job->skipped = !reused;
+  job->reused = reused;
+
+  g_mutex_lock (&dec->lock);
+  g_queue_push_tail (&dec->pending, job);
+  g_mutex_unlock (&dec->lock);
+
+  return gst_turbojpegdec_push_completed (dec,
+      g_thread_pool_get_max_threads (dec->pool) - 1);
+}
+
+/* Drop a frame that is too late to be shown */
+static GstFlowReturn
+gst_turbojpegdec_skip_frame (GstTurboJpegDec * dec, GstVideoCodecFrame * frame)
+{
+  if (!dec->pool || g_queue_is_empty (&dec->pending))
+    return gst_video_decoder_drop_frame (GST_VIDEO_DECODER (dec), frame);
+
+  return gst_turbojpegdec_queue_undecoded (dec, frame, FALSE);
+}
+
+static void
+gst_turbojpegdec_free_cache_key (gpointer key)
+{
+  g_slice_free (GstTurboJpegCacheKey, key);
+}
+
+/* Whether the previous frame left an output to reuse, or will once the
+ * workers are done with it */
+static gboolean
+gst_turbojpegdec_can_reuse (GstTurboJpegDec * dec)
+{
+  return dec->dup_output || (dec->pool && !g_queue_is_empty (&dec->pending));
+}
+
+/* Push a frame without decoding it, in decode order: a frame identical to
+ * the previous one with its output, or one whose output_buffer already
+ * holds a cached or lazily decoded frame */
+static GstFlowReturn
+gst_turbojpegdec_push_undecoded (GstTurboJpegDec * dec,
+    GstVideoCodecFrame * frame)
+{
+  if (dec->pool && !g_queue_is_empty (&dec->pending))
+    return gst_turbojpegdec_queue_undecoded (dec, frame, TRUE);
+
+  return gst_turbojpegdec_push_reused (dec, frame);
+}
+
+/* Trade resolution for frame rate: a late frame lowers the decode scale
+ * one step and is decoded at it. The scale is raised again only after a
+ * run of frames with time to spare. Returns TRUE if the frame is late and
+ * has to be dropped anyway */
+static gboolean
+gst_turbojpegdec_adapt_scale (GstTurboJpegDec * dec,
+    GstClockTimeDiff deadline)
+{
+  GstClockTimeDiff slack = ADAPTIVE_DEFAULT_SLACK;
+  gint fps_n, fps_d;
+
+  if (dec->adaptive_settle > 0) {
+    dec->adaptive_settle--;
+    return deadline < 0;
+  }
+
+  if (deadline < 0) {
+    dec->adaptive_good_frames = 0;
+    if (dec->adaptive_level >= ADAPTIVE_MAX_LEVEL)
+      return TRUE;
+
+    dec->adaptive_level++;
+    dec->adaptive_settle = ADAPTIVE_SETTLE_FRAMES;
+    GST_INFO_OBJECT (dec, "Falling behind, decoding at 1/%d scale",
+        1 << dec->adaptive_level);
+    return FALSE;
+  }
+
+  if (dec->adaptive_level == 0)
+    return FALSE;
+
+  if (dec->input_state) {
+    fps_n = GST_VIDEO_INFO_FPS_N (&dec->input_state->info);
+    fps_d = GST_VIDEO_INFO_FPS_D (&dec->input_state->info);
+    if (fps_n > 0 && fps_d > 0)
+      slack = gst_util_uint64_scale_int (GST_SECOND, fps_d, fps_n);
+  }
+
+  if (deadline < slack) {
+    dec->adaptive_good_frames = 0;
+    return FALSE;
+  }
+
+  if (++dec->adaptive_good_frames >= ADAPTIVE_RECOVER_FRAMES) {
+    dec->adaptive_level--;
+    dec->adaptive_good_frames = 0;
+    dec->adaptive_settle = ADAPTIVE_SETTLE_FRAMES;
+    GST_INFO_OBJECT (dec, "Caught up, decoding at 1/%d scale",
+        1 << dec->adaptive_level);
+  }
+
+  return FALSE;
+}
+
+/* Fill the header_* fields for the JPEG in @map_info. The full TurboJPEG
+ * header parse only runs when the decode-relevant header segments differ
+ * from the previous frame's */
+static gboolean
+gst_turbojpegdec_parse_header (GstTurboJpegDec * dec, GstMapInfo * map_info)
+{
+  gint width, height;
+
+  if (gst_turbojpeg_header_fingerprint (map_info->data, map_info->size,
+          dec->header_key) && dec->header_valid)
+    return TRUE;
+
+  dec->header_valid = FALSE;
+
+  if (tj3DecompressHeader (dec->tjInstanceHeader, map_info->data,
+          map_info->size) < 0) {
     GST_ERROR_OBJECT (dec, "Failed to decompress JPEG header: %s",
         tj3GetErrorStr (dec->tjInstanceHeader));
-    gst_buffer_unmap (frame->input_buffer, &map_info);
-    return GST_FLOW_ERROR;
+    return FALSE;
   }
 
   width = tj3Get (dec->tjInstanceHeader, TJPARAM_JPEGWIDTH);
   height = tj3Get (dec->tjInstanceHeader, TJPARAM_JPEGHEIGHT);
-  subsamp = tj3Get (dec->tjInstanceHeader, TJPARAM_SUBSAMP);
 
   /* Validate dimensions */
   if (width <= 0 || height <= 0 || width > 32768 || height > 32768) {
     GST_ERROR_OBJECT (dec, "Invalid JPEG dimensions: %dx%d", width, height);
+    return FALSE;
+  }
+
+  dec->header_width = width;
+  dec->header_height = height;
+  dec->header_subsamp = tj3Get (dec->tjInstanceHeader, TJPARAM_SUBSAMP);
+  dec->header_lossless = tj3Get (dec->tjInstanceHeader,
+      TJPARAM_LOSSLESS) == 1;
+  dec->header_precision = tj3Get (dec->tjInstanceHeader, TJPARAM_PRECISION);
+  if (dec->header_precision < 2 || dec->header_precision > 16) {
+    GST_ERROR_OBJECT (dec, "Unsupported JPEG precision: %d",
+        dec->header_precision);
+    return FALSE;
+  }
+  dec->header_valid = TRUE;
+
+  GST_DEBUG_OBJECT (dec, "JPEG: %dx%d, subsampling: %d, %d-bit%s", width,
+      height, dec->header_subsamp, dec->header_precision,
+      dec->header_lossless ? " lossless" : "");
+
+  return TRUE;
+}
+
+/* What a lazy memory needs to decode its frame */
+typedef struct
+{
+  GstTurboJpegDec *dec;
+  GstVideoInfo info;
+  GstTurboJpegDecParams params;
+} GstTurboJpegDecLazy;
+
+static void
+gst_turbojpegdec_lazy_free (gpointer data)
+{
+  GstTurboJpegDecLazy *lazy = data;
+
+  gst_object_unref (lazy->dec);
+  g_slice_free (GstTurboJpegDecLazy, lazy);
+}
+
+/* Paint @frame black, standing in for a frame that failed to decode */
+static void
+gst_turbojpegdec_fill_black (GstVideoFrame * frame)
+{
+  const GstVideoFormatInfo *finfo = frame->info.finfo;
+  gint c, x, y, b;
+
+  for (c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS (frame); c++) {
+    guint8 *data = GST_VIDEO_FRAME_COMP_DATA (frame, c);
+    gint stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, c);
+    gint pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (frame, c);
+    gint bytes = GST_VIDEO_FORMAT_INFO_DEPTH (finfo, c) > 8 ? 2 : 1;
+    guint8 value = 0;
+
+    /* 16-bit formats are all RGB or gray, where black is 0 and opaque is
+     * all ones in either byte order */
+    if (c == GST_VIDEO_COMP_A)
+      value = 0xFF;
+    else if (GST_VIDEO_FORMAT_INFO_IS_YUV (finfo))
+      value = c == GST_VIDEO_COMP_Y ? 16 : 128;
+
+    for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (frame, c); y++) {
+      guint8 *p = data + (gsize) y * stride;
+
+      for (x = 0; x < GST_VIDEO_FRAME_COMP_WIDTH (frame, c); x++) {
+        for (b = 0; b < bytes; b++)
+          p[b] = value;
+        p += pstride;
+      }
+    }
+  }
+}
+
+/* Decode a frame for whoever maps its memory first, on their thread. A
+ * corrupt frame comes out black rather than failing the map, which would
+ * be fatal to the mapping element whatever max-errors says */
+static gboolean
+gst_turbojpegdec_lazy_decode (gpointer user_data, GstMapInfo * input,
+    guint8 * data, gsize size)
+{
+  GstTurboJpegDecLazy *lazy = user_data;
+  GstTurboJpegDec *dec = lazy->dec;
+  GstFlowReturn ret = GST_FLOW_ERROR;
+  GstVideoFrame frame;
+  GstBuffer *buffer;
+  tjhandle handle;
+
+  buffer = gst_buffer_new_wrapped_full (0, data, size, 0, size, NULL, NULL);
+  if (!gst_video_frame_map (&frame, &lazy->info, buffer, GST_MAP_WRITE)) {
+    gst_buffer_unref (buffer);
+    return FALSE;
+  }
+
+  handle = g_async_queue_try_pop (dec->lazy_handles);
+  if (!handle)
+    handle = tj3Init (TJINIT_DECOMPRESS);
+  if (handle) {
+    ret = gst_turbojpegdec_decode (dec, handle, input, &frame, &lazy->params);
+    g_async_queue_push (dec->lazy_handles, handle);
+  } else {
+    GST_ERROR_OBJECT (dec, "Failed to initialize TurboJPEG lazy instance");
+  }
+
+  if (ret != GST_FLOW_OK) {
+    GST_WARNING_OBJECT (dec, "Failed to decode frame on map, output black");
+    gst_turbojpegdec_fill_black (&frame);
+  }
+
+  gst_video_frame_unmap (&frame);
+  gst_buffer_unref (buffer);
+
+  return TRUE;
+}
+
+/* Give @frame an output buffer whose memory decodes it when first mapped */
+static void
+gst_turbojpegdec_allocate_lazy (GstTurboJpegDec * dec,
+    GstVideoCodecFrame * frame, const GstTurboJpegDecParams * params)
+{
+  GstTurboJpegDecLazy *lazy = g_slice_new (GstTurboJpegDecLazy);
+  GstBuffer *input;
+
+  lazy->dec = gst_object_ref (dec);
+  lazy->info = dec->output_state->info;
+  lazy->params = *params;
+
+  /* The memory holds the input until it is mapped, which for cached or
+   * repeated frames may be never. Pool buffers are copied so upstream can
+   * recycle them, as in the cache */
+  if (frame->input_buffer->pool)
+    input = gst_buffer_copy_deep (frame->input_buffer);
+  else
+    input = gst_buffer_ref (frame->input_buffer);
+
+  frame->output_buffer = gst_buffer_new ();
+  gst_buffer_append_memory (frame->output_buffer,
+      gst_turbojpeg_lazy_memory_new (input,
+          GST_VIDEO_INFO_SIZE (&lazy->info), gst_turbojpegdec_lazy_decode,
+          lazy, gst_turbojpegdec_lazy_free));
+  gst_buffer_unref (input);
+}
+
+static GstFlowReturn
+gst_turbojpegdec_handle_frame (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame)
+{
+  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (decoder);
+  GstMapInfo map_info;
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstVideoFrame video_frame;
+  GstTurboJpegDecParams params;
+  gint width, height, subsamp;
+  gint precision;
+  gboolean lossless, settings_changed, late;
+  GstClockTimeDiff deadline;
+  tjregion region;
+  gboolean format_changed = FALSE;
+  gboolean skip_duplicates, caching, lazy_decode;
+  GstTurboJpegCacheKey key;
+  GstBuffer *cached;
+  guint64 hash = 0;
+
+  if (!gst_buffer_map (frame->input_buffer, &map_info, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (dec, "Failed to map input buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  /* Validate input buffer */
+  if (!map_info.data || map_info.size < 4) {
+    GST_ERROR_OBJECT (dec, "Invalid or too small input buffer: size=%" G_GSIZE_FORMAT,
+        map_info.size);
+    gst_buffer_unmap (frame->input_buffer, &map_info);
+    return GST_FLOW_ERROR;
+  }
+
+  /* Check for JPEG magic bytes */
+  if (map_info.data[0] != 0xFF || map_info.data[1] != 0xD8) {
+    GST_ERROR_OBJECT (dec, "Invalid JPEG magic bytes: 0x%02X 0x%02X",
+        map_info.data[0], map_info.data[1]);
+    gst_buffer_unmap (frame->input_buffer, &map_info);
+    return GST_FLOW_ERROR;
+  }
+
+  if (!gst_turbojpegdec_parse_header (dec, &map_info)) {
     gst_buffer_unmap (frame->input_buffer, &map_info);
     return GST_FLOW_ERROR;
   }
 
-  GST_DEBUG_OBJECT (dec, "JPEG: %dx%d, subsampling: %d", width, height, subsamp);
+  width = dec->header_width;
+  height = dec->header_height;
+  subsamp = dec->header_subsamp;
+  lossless = dec->header_lossless;
+  precision = dec->header_precision;
+
+  /* Frames already late downstream are dropped before any entropy decoding,
+   * unless a lower scale can still make them. The base class counts drops
+   * in the QoS messages it posts */
+  deadline = gst_video_decoder_get_max_decode_time (decoder, frame);
+  if (dec->adaptive_scale && !lossless)
+    late = gst_turbojpegdec_adapt_scale (dec, deadline);
+  else
+    late = deadline < 0;
+
+  if (late) {
+    GST_DEBUG_OBJECT (dec, "Dropping late frame %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (frame->pts));
+    gst_buffer_unmap (frame->input_buffer, &map_info);
+    return gst_turbojpegdec_skip_frame (dec, frame);
+  }
 
-  if (!dec->output_state || 
-      GST_VIDEO_INFO_WIDTH (&dec->output_state->info) != width ||
-      GST_VIDEO_INFO_HEIGHT (&dec->output_state->info) != height) {
+  GST_OBJECT_LOCK (dec);
+  settings_changed = dec->scale_changed || dec->roi_changed ||
+      dec->luma_only_changed || dec->mcu_padded_changed;
+  dec->scale_changed = dec->roi_changed = dec->luma_only_changed =
+      dec->mcu_padded_changed = FALSE;
+  skip_duplicates = dec->skip_duplicates;
+  lazy_decode = dec->lazy_decode;
+  if (dec->scale_n == 0)
+    settings_changed |= gst_pad_needs_reconfigure (GST_VIDEO_DECODER_SRC_PAD
+        (decoder));
+  GST_OBJECT_UNLOCK (dec);
+
+  /* The best output format depends on the JPEG subsampling too, and an
+   * automatic scale on what downstream currently accepts */
+  if (!dec->output_state || dec->jpeg_width != width ||
+      dec->jpeg_height != height || dec->jpeg_lossless != lossless ||
+      dec->jpeg_precision != precision ||
+      dec->chroma_subsamp != subsamp || settings_changed ||
+      dec->negotiated_level != dec->adaptive_level) {
     format_changed = TRUE;
   }
 
   if (format_changed) {
-    ret = gst_turbojpegdec_negotiate_format (dec, width, height, subsamp);
+    /* Frames still in flight were allocated for the previous caps */
+    if (dec->pool) {
+      ret = gst_turbojpegdec_push_completed (dec, 0);
+      if (ret != GST_FLOW_OK) {
+        gst_buffer_unmap (frame->input_buffer, &map_info);
+        gst_video_decoder_release_frame (decoder, frame);
+        return ret;
+      }
+    }
+
+    /* Earlier output no longer matches what this frame decodes to */
+    gst_turbojpegdec_reset_duplicates (dec);
+
+    ret = gst_turbojpegdec_negotiate_format (dec, width, height, subsamp,
+        lossless, precision);
     if (ret != GST_FLOW_OK) {
       GST_ERROR_OBJECT (dec, "Failed to negotiate output format");
       gst_buffer_unmap (frame->input_buffer, &map_info);
@@ -614,11 +2916,100 @@ gst_turbojpegdec_handle_frame (GstVideoDecoder * decoder,
     }
   }
 
-  ret = gst_video_decoder_allocate_output_frame (decoder, frame);
-  if (ret != GST_FLOW_OK) {
-    GST_ERROR_OBJECT (dec, "Failed to allocate output frame");
+  /* Identical compressed bytes decode to identical output */
+  caching = gst_turbojpeg_cache_get_budget (dec->cache) > 0;
+  if (skip_duplicates || caching)
+    hash = gst_turbojpeg_hash (map_info.data, map_info.size);
+
+  if (skip_duplicates) {
+    if (dec->dup_valid && dec->dup_hash == hash &&
+        dec->dup_size == map_info.size && gst_turbojpegdec_can_reuse (dec)) {
+      GST_LOG_OBJECT (dec, "Reusing output for repeated frame %u",
+          frame->system_frame_number);
+      GST_OBJECT_LOCK (dec);
+      dec->dup_hits++;
+      GST_OBJECT_UNLOCK (dec);
+      gst_buffer_unmap (frame->input_buffer, &map_info);
+      return gst_turbojpegdec_push_undecoded (dec, frame);
+    }
+
+    GST_OBJECT_LOCK (dec);
+    dec->dup_misses++;
+    GST_OBJECT_UNLOCK (dec);
+    gst_buffer_replace (&dec->dup_output, NULL);
+    dec->dup_valid = TRUE;
+    dec->dup_hash = hash;
+    dec->dup_size = map_info.size;
+    dec->dup_frame = frame->system_frame_number;
+  }
+
+  if (caching) {
+    key.hash = hash;
+    key.size = map_info.size;
+    key.variant = dec->cache_variant;
+    cached = gst_turbojpeg_cache_lookup (dec->cache, &key);
+    if (cached) {
+      GST_LOG_OBJECT (dec, "Frame %u found in the cache",
+          frame->system_frame_number);
+      frame->output_buffer = gst_buffer_copy (cached);
+      gst_buffer_unref (cached);
+      gst_buffer_unmap (frame->input_buffer, &map_info);
+      return gst_turbojpegdec_push_undecoded (dec, frame);
+    }
+
+    /* Stored once the frame is decoded and pushed */
+    gst_video_codec_frame_set_user_data (frame,
+        g_slice_dup (GstTurboJpegCacheKey, &key),
+        gst_turbojpegdec_free_cache_key);
+  }
+
+  /* TurboJPEG cannot crop planar output, so the JPEG itself is cropped */
+  region = dec->region;
+  if (region.w && !gst_turbojpegdec_is_packed_tj_format (GST_VIDEO_INFO_FORMAT
+          (&dec->output_state->info))) {
+    ret = gst_turbojpegdec_crop_input (dec, frame, &map_info, &region);
+    if (ret != GST_FLOW_OK) {
+      gst_buffer_unmap (frame->input_buffer, &map_info);
+      return gst_turbojpegdec_push_decoded (dec, frame, ret);
+    }
+    region = TJUNCROPPED;
+  }
+
+  params.width = GST_VIDEO_INFO_WIDTH (&dec->output_state->info);
+  params.height = GST_VIDEO_INFO_HEIGHT (&dec->output_state->info);
+  params.subsamp = subsamp;
+  params.precision = precision;
+  params.scale = dec->scaling;
+  params.region = region;
+  params.convert = dec->chroma_convert;
+  params.padded = dec->planes_padded && !lazy_decode;
+  params.chroma = dec->chroma_plan;
+
+  if (lazy_decode) {
+    gst_turbojpegdec_allocate_lazy (dec, frame, &params);
+  } else {
+    ret = gst_video_decoder_allocate_output_frame (decoder, frame);
+    if (ret != GST_FLOW_OK) {
+      GST_ERROR_OBJECT (dec, "Failed to allocate output frame");
+      gst_buffer_unmap (frame->input_buffer, &map_info);
+      return ret;
+    }
+  }
+
+  if (dec->crop_width > 0) {
+    GstVideoCropMeta *crop =
+        gst_buffer_add_video_crop_meta (frame->output_buffer);
+
+    crop->x = dec->crop_x;
+    crop->y = dec->crop_y;
+    crop->width = dec->crop_width;
+    crop->height = dec->crop_height;
+  }
+
+  /* Decoding is left to whoever maps the frame first */
+  if (lazy_decode) {
     gst_buffer_unmap (frame->input_buffer, &map_info);
-    return ret;
+    return gst_turbojpegdec_push_undecoded (dec, frame);
   }
 
   if (!gst_video_frame_map (&video_frame, &dec->output_state->info,
@@ -628,88 +3019,164 @@ gst_turbojpegdec_handle_frame (GstVideoDecoder * decoder,
     return GST_FLOW_ERROR;
   }
 
+  /* Hand the frame to a worker; the mappings are released once it is pushed */
+  if (dec->pool)
+    return gst_turbojpegdec_submit_job (dec, frame, &map_info, &video_frame,
+        &params);
+
   /* Decode based on output format */
-  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (&video_frame);
-  if (format == GST_VIDEO_FORMAT_I420 || format == GST_VIDEO_FORMAT_YV12 ||
-      format == GST_VIDEO_FORMAT_Y42B || format == GST_VIDEO_FORMAT_Y444) {
-    ret = gst_turbojpegdec_decode_yuv (dec, &map_info, &video_frame, subsamp, width, height);
-  } else {
-    ret = gst_turbojpegdec_decode_rgb (dec, &map_info, &video_frame);
+  if (!dec->slice_pool || !gst_turbojpegdec_decode_slices (dec, &map_info,
+          &video_frame, &params, &ret)) {
+    ret = gst_turbojpegdec_decode (dec,
+        gst_turbojpegdec_decodes_to_planes (GST_VIDEO_FRAME_FORMAT
+            (&video_frame)) ?
+        dec->tjInstanceYUV : dec->tjInstanceRGB, &map_info, &video_frame,
+        &params);
   }
 
   gst_video_frame_unmap (&video_frame);
   gst_buffer_unmap (frame->input_buffer, &map_info);
 
-  if (ret == GST_FLOW_OK) {
-    dec->error_count = 0;
-    ret = gst_video_decoder_finish_frame (decoder, frame);
-  } else {
-    gst_video_decoder_drop_frame (decoder, frame);
+  return gst_turbojpegdec_push_decoded (dec, frame, ret);
+}
+
+static GstFlowReturn
+gst_turbojpegdec_finish (GstVideoDecoder * decoder)
+{
+  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (decoder);
+
+  return gst_turbojpegdec_push_completed (dec, 0);
+}
+
+static GstFlowReturn
+gst_turbojpegdec_drain (GstVideoDecoder * decoder)
+{
+  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (decoder);
+
+  return gst_turbojpegdec_push_completed (dec, 0);
+}
+
+static gboolean
+gst_turbojpegdec_flush (GstVideoDecoder * decoder)
+{
+  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (decoder);
+
+  gst_turbojpegdec_discard_pending (dec);
+  gst_turbojpegdec_reset_duplicates (dec);
+  return TRUE;
+}
+
+static gboolean
+gst_turbojpegdec_src_event (GstVideoDecoder * decoder, GstEvent * event)
+{
+  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (decoder);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_UPSTREAM &&
+      gst_event_has_name (event, ROI_EVENT_NAME)) {
+    const GstStructure *s = gst_event_get_structure (event);
+    gint x, y, width, height;
+
+    if (gst_structure_get (s, "x", G_TYPE_INT, &x, "y", G_TYPE_INT, &y,
+            "width", G_TYPE_INT, &width, "height", G_TYPE_INT, &height, NULL)
+        && x >= 0 && y >= 0 && width >= 0 && height >= 0) {
+      GST_DEBUG_OBJECT (dec, "Region of interest %dx%d at %d,%d", width,
+          height, x, y);
+      GST_OBJECT_LOCK (dec);
+      dec->roi_x = x;
+      dec->roi_y = y;
+      dec->roi_width = width;
+      dec->roi_height = height;
+      dec->roi_changed = TRUE;
+      GST_OBJECT_UNLOCK (dec);
+    } else {
+      GST_WARNING_OBJECT (dec, "Ignoring malformed region of interest event");
+    }
+
+    gst_event_unref (event);
+    return TRUE;
   }
 
-  return ret;
+  return GST_VIDEO_DECODER_CLASS (parent_class)->src_event (decoder, event);
 }
 
+/* The base class keeps downstream's pool, or makes a video pool, and turns
+ * on video meta when downstream handles it. Frames are then decoded
+ * straight into that memory; all that is added is the few samples of
+ * padding TurboJPEG's MCU-padded planes need, merged into whatever
+ * alignment the pool already has */
 static gboolean
 gst_turbojpegdec_decide_allocation (GstVideoDecoder * decoder, GstQuery * query)
 {
   GstTurboJpegDec *dec = GST_TURBOJPEGDEC (decoder);
-  GstBufferPool *pool;
-  GstStructure *config;
-  GstCaps *caps;
-  guint size, min, max;
-  gboolean update_pool;
+  GstBufferPool *pool = NULL;
+  GstStructure *config, *fallback;
+  GstVideoAlignment align;
+  guint i;
+
+  dec->planes_padded = FALSE;
 
   if (!GST_VIDEO_DECODER_CLASS (parent_class)->decide_allocation (decoder, query))
     return FALSE;
 
-  if (gst_query_get_n_allocation_pools (query) > 0) {
-    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
-    update_pool = TRUE;
-  } else {
-    pool = NULL;
-    size = 0;
-    min = max = 0;
-    update_pool = FALSE;
-  }
-
-  if (!pool) {
-    pool = gst_video_buffer_pool_new ();
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, NULL, NULL, NULL);
+  if (!pool)
+    return TRUE;
+
+  /* Padded strides and offsets can only be described with video meta */
+  if (!gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL) ||
+      !gst_buffer_pool_has_option (pool,
+          GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT)) {
+    GST_DEBUG_OBJECT (dec, "Pool %" GST_PTR_FORMAT " cannot be padded, MCU "
+        "padding will go through scratch", pool);
+    gst_object_unref (pool);
+    return TRUE;
   }
 
-  gst_query_parse_allocation (query, &caps, NULL);
-
+  fallback = gst_buffer_pool_get_config (pool);
   config = gst_buffer_pool_get_config (pool);
-  gst_buffer_pool_config_set_params (config, caps, size, min, max);
-  gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
-  gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+  gst_buffer_pool_config_add_option (config,
+      GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
 
-  /* Set proper alignment for SIMD operations */
-  if (gst_buffer_pool_config_has_option (config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT)) {
-    GstVideoAlignment align;
+  if (!gst_buffer_pool_config_get_video_alignment (config, &align))
     gst_video_alignment_reset (&align);
-    /* Align to 16-pixel boundaries for TurboJPEG MCU requirements */
-    align.stride_align[0] = 15;  /* 16-byte alignment (15 = 16-1) */
-    align.stride_align[1] = 15;  /* 16-byte alignment */
-    align.stride_align[2] = 15;  /* 16-byte alignment */
-    /* Add padding for MCU boundary alignment */
-    align.padding_right = 15;    /* Pad width to MCU boundary */
-    align.padding_bottom = 15;   /* Pad height to MCU boundary */
-    gst_buffer_pool_config_set_video_alignment (config, &align);
-  }
-
-  if (!gst_buffer_pool_set_config (pool, config)) {
-    GST_ERROR_OBJECT (dec, "Failed to set buffer pool configuration");
-    gst_object_unref (pool);
-    return FALSE;
-  }
-
-  if (update_pool) {
-    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  align.padding_right = MAX (align.padding_right, MCU_PLANE_PADDING);
+  align.padding_bottom = MAX (align.padding_bottom, MCU_PLANE_PADDING);
+  /* Stride alignments are masks, so OR keeps the stricter of the two */
+  for (i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+    align.stride_align[i] |= 15;
+  gst_buffer_pool_config_set_video_alignment (config, &align);
+
+  if (gst_buffer_pool_set_config (pool, config)) {
+    dec->planes_padded = TRUE;
+    gst_structure_free (fallback);
   } else {
-    gst_query_add_allocation_pool (query, pool, size, min, max);
+    /* A failed set_config leaves the pool unconfigured */
+    GST_DEBUG_OBJECT (dec, "Pool %" GST_PTR_FORMAT " rejected MCU padding",
+        pool);
+    if (!gst_buffer_pool_set_config (pool, fallback)) {
+      GST_ERROR_OBJECT (dec, "Failed to restore buffer pool configuration");
+      gst_object_unref (pool);
+      return FALSE;
+    }
   }
 
   gst_object_unref (pool);
   return TRUE;
-}
\ No newline at end of file
+}
+
+/* Block maps are laid out on the whole JPEG at full size, so they only
+ * carry over to frames decoded that way */
+static gboolean
+gst_turbojpegdec_transform_meta (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame, GstMeta * meta)
+{
+  GstTurboJpegDec *dec = GST_TURBOJPEGDEC (decoder);
+
+  if (meta->info->api == GST_TURBOJPEG_BLOCK_META_API_TYPE &&
+      (dec->scaling.num != dec->scaling.denom || dec->region.w != 0))
+    return FALSE;
+
+  return GST_VIDEO_DECODER_CLASS (parent_class)->transform_meta (decoder,
+      frame, meta);
+}
@@ -6,6 +6,10 @@
 #include <gst/video/gstvideodecoder.h>
 #include <turbojpeg.h>
 
+#include "gstturbojpegconvert.h"
+#include "gstturbojpegarena.h"
+#include "gstturbojpegcache.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_TURBOJPEGDEC \
@@ -35,6 +39,95 @@ struct _GstTurboJpegDec
   
   GstVideoCodecState *input_state;
   GstVideoCodecState *output_state;
+
+  /* Frame-parallel decoding */
+  gint n_threads;
+  GThreadPool *pool;          /* Worker pool, NULL when decoding serially */
+  GAsyncQueue *handles;       /* Idle per-worker TurboJPEG instances */
+  GQueue pending;             /* In-flight jobs in decode order */
+  GMutex lock;
+  GCond cond;
+
+  /* Restart-marker slice decoding */
+  gint slice_threads;
+  GThreadPool *slice_pool;    /* Slice workers, NULL when disabled */
+  GAsyncQueue *slice_handles;
+  GByteArray *slice_storage;  /* Band JPEGs of the current frame */
+
+  /* Chroma resampling into the negotiated YUV layout */
+  gint chroma_subsamp;        /* JPEG subsampling the plan was built for */
+  gboolean chroma_convert;    /* Output planes differ from the JPEG's */
+  GstTurboJpegChromaPlan chroma_plan;
+  GstTurboJpegArena *arena;   /* Scratch planes reused across frames */
+  gboolean planes_padded;     /* Output pool pads frames for MCU padding */
+
+  /* DCT-domain scaling, protected by the object lock */
+  gint scale_n;               /* 0/1 picks the factor from downstream caps */
+  gint scale_d;
+  gboolean scale_changed;
+
+  /* GRAY8 output from the luma alone, protected by the object lock */
+  gboolean luma_only;
+  gboolean luma_only_changed;
+
+  /* iMCU-padded planar output, protected by the object lock */
+  gboolean mcu_padded;
+  gboolean mcu_padded_changed;
+
+  /* JPEG the output state was negotiated for */
+  gint jpeg_width;
+  gint jpeg_height;
+  gboolean jpeg_lossless;
+  gint jpeg_precision;
+  tjscalingfactor scaling;    /* Factor applied to its frames */
+
+  /* Region of interest in JPEG pixels, protected by the object lock */
+  gint roi_x;
+  gint roi_y;
+  gint roi_width;             /* 0 decodes the whole frame */
+  gint roi_height;
+  gboolean roi_changed;
+
+  tjhandle tjInstanceTransform; /* Lossless crops for planar output */
+  tjregion region;            /* iMCU-aligned area decoded, w == 0 if all */
+  gint crop_x;                /* Rest of the ROI crop, in output pixels, */
+  gint crop_y;                /* left to downstream as a crop meta */
+  gint crop_width;            /* 0 when no crop meta is needed */
+  gint crop_height;
+
+  /* Header parse cache */
+  GByteArray *header_key;     /* Header segments of the last parsed JPEG */
+  gboolean header_valid;      /* The fields below describe it */
+  gint header_width;
+  gint header_height;
+  gint header_subsamp;
+  gboolean header_lossless;
+  gint header_precision;
+
+  /* Adaptive scaling under load */
+  gboolean adaptive_scale;
+  gint adaptive_level;        /* Decode at no more than 1/2^level */
+  gint negotiated_level;      /* Level the output state was built for */
+  gint adaptive_settle;       /* Frames before lateness counts again */
+  gint adaptive_good_frames;  /* Consecutive frames with time to spare */
+
+  /* Reuse of the output for repeated frames */
+  gboolean skip_duplicates;
+  gboolean dup_valid;         /* The fields below describe the last frame */
+  guint64 dup_hash;           /* Hash of its compressed bytes */
+  gsize dup_size;
+  guint32 dup_frame;          /* Its system frame number */
+  GstBuffer *dup_output;      /* Its decoded output, once pushed */
+  guint64 dup_hits;           /* Protected by the object lock */
+  guint64 dup_misses;
+
+  /* Decoded frames of recurring JPEGs */
+  GstTurboJpegCache *cache;
+  guint64 cache_variant;      /* Output configuration part of the keys */
+
+  /* Decode on first map of the output memory */
+  gboolean lazy_decode;
+  GAsyncQueue *lazy_handles;  /* Idle instances of lazy decodes */
 };
 
 struct _GstTurboJpegDecClass
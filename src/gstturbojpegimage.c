@@ -0,0 +1,122 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstturbojpegimage.h"
+
+/* The size, pixel shape and sampling of the output depend on every image,
+ * so they are left out of the caps until the first one is processed */
+GstCaps *
+gst_turbojpeg_image_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter)
+{
+  GstCaps *ret;
+  guint i;
+
+  ret = gst_caps_copy (caps);
+  for (i = 0; i < gst_caps_get_size (ret); i++)
+    gst_structure_remove_fields (gst_caps_get_structure (ret, i), "width",
+        "height", "pixel-aspect-ratio", "sampling", NULL);
+
+  if (filter) {
+    GstCaps *tmp = gst_caps_intersect_full (filter, ret,
+        GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (ret);
+    ret = tmp;
+  }
+
+  return ret;
+}
+
+/* Forget the announced geometry, e.g. after the src caps were negotiated
+ * again without it */
+void
+gst_turbojpeg_image_caps_reset (GstTurboJpegImageCaps * out)
+{
+  out->width = out->height = 0;
+  out->transposed = FALSE;
+}
+
+/* Announce a @width x @height output image downstream when it differs from
+ * the last one. @transposed images swap rows and columns, so their pixel
+ * aspect ratio is the inverse of the sink's */
+gboolean
+gst_turbojpeg_image_update_caps (GstBaseTransform * trans,
+    GstTurboJpegImageCaps * out, gint width, gint height,
+    gboolean transposed)
+{
+  GstCaps *caps, *sink_caps;
+  gint par_n, par_d;
+  gboolean ret;
+
+  if (width == out->width && height == out->height &&
+      transposed == out->transposed)
+    return TRUE;
+
+  caps = gst_pad_get_current_caps (GST_BASE_TRANSFORM_SRC_PAD (trans));
+  if (caps)
+    caps = gst_caps_make_writable (caps);
+  else
+    caps = gst_caps_new_empty_simple ("image/jpeg");
+  gst_caps_set_simple (caps, "width", G_TYPE_INT, width, "height",
+      G_TYPE_INT, height, NULL);
+
+  sink_caps = gst_pad_get_current_caps (GST_BASE_TRANSFORM_SINK_PAD (trans));
+  if (sink_caps && gst_structure_get_fraction (gst_caps_get_structure
+          (sink_caps, 0), "pixel-aspect-ratio", &par_n, &par_d) && par_n > 0) {
+    if (transposed)
+      gst_caps_set_simple (caps, "pixel-aspect-ratio", GST_TYPE_FRACTION,
+          par_d, par_n, NULL);
+    else
+      gst_caps_set_simple (caps, "pixel-aspect-ratio", GST_TYPE_FRACTION,
+          par_n, par_d, NULL);
+  }
+  if (sink_caps)
+    gst_caps_unref (sink_caps);
+
+  ret = gst_base_transform_update_src_caps (trans, caps);
+  gst_caps_unref (caps);
+
+  if (ret) {
+    out->width = width;
+    out->height = height;
+    out->transposed = transposed;
+  }
+  return ret;
+}
+
+/* Read the header of the JPEG in @data into @handle. Returns its
+ * subsampling, or TJSAMP_UNKNOWN when the header is invalid or the image
+ * does not decode to YUV planes, which takes 8-bit DCT coding */
+gint
+gst_turbojpeg_image_read_yuv_header (tjhandle handle, const guint8 * data,
+    gsize size)
+{
+  if (tj3DecompressHeader (handle, data, size) < 0)
+    return TJSAMP_UNKNOWN;
+
+  if (tj3Get (handle, TJPARAM_LOSSLESS) == 1 ||
+      tj3Get (handle, TJPARAM_PRECISION) != 8)
+    return TJSAMP_UNKNOWN;
+
+  return tj3Get (handle, TJPARAM_SUBSAMP);
+}
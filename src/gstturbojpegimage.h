@@ -0,0 +1,50 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_IMAGE_H__
+#define __GST_TURBOJPEG_IMAGE_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <turbojpeg.h>
+
+G_BEGIN_DECLS
+
+/* Geometry an image/jpeg to image/jpeg element last put on its src caps */
+typedef struct
+{
+  gint width;                 /* 0 until the first image sets it */
+  gint height;
+  gboolean transposed;        /* Pixel aspect ratio inverted from the sink's */
+} GstTurboJpegImageCaps;
+
+GstCaps *gst_turbojpeg_image_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter);
+
+void gst_turbojpeg_image_caps_reset (GstTurboJpegImageCaps * out);
+gboolean gst_turbojpeg_image_update_caps (GstBaseTransform * trans,
+    GstTurboJpegImageCaps * out, gint width, gint height,
+    gboolean transposed);
+
+gint gst_turbojpeg_image_read_yuv_header (tjhandle handle,
+    const guint8 * data, gsize size);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_IMAGE_H__ */
@@ -0,0 +1,288 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstturbojpeglazy.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_turbojpeg_lazy_debug);
+#define GST_CAT_DEFAULT gst_turbojpeg_lazy_debug
+
+/* Alignment of the decoded planes, a cache line and the widest SIMD
+ * register */
+#define LAZY_ALIGN 63
+
+/* Raw video that is only decoded when first mapped. Shares made of a lazy
+ * memory keep its root as parent and map through it, so a frame is decoded
+ * once however many buffers refer to it */
+typedef struct
+{
+  GstMemory mem;
+
+  GMutex lock;                /* Serialises the decode of a root memory */
+  GstBuffer *input;           /* Compressed frame, dropped once decoded */
+  GstTurboJpegLazyDecodeFunc decode;
+  gpointer user_data;
+  GDestroyNotify notify;
+
+  GstMemory *backing;         /* Decoded frame, NULL until mapped */
+  GstMapInfo backing_map;
+  gboolean failed;
+} GstTurboJpegLazyMemory;
+
+G_DEFINE_TYPE (GstTurboJpegLazyAllocator, gst_turbojpeg_lazy_allocator,
+    GST_TYPE_ALLOCATOR);
+
+static GstAllocator *lazy_allocator;
+
+static GstTurboJpegLazyMemory *
+gst_turbojpeg_lazy_memory_root (GstMemory * mem)
+{
+  return (GstTurboJpegLazyMemory *) (mem->parent ? mem->parent : mem);
+}
+
+/* Runs with the root's lock held */
+static gboolean
+gst_turbojpeg_lazy_memory_decode (GstTurboJpegLazyMemory * lmem)
+{
+  GstAllocationParams params;
+  GstMapInfo input;
+  gboolean ok;
+
+  if (lmem->backing)
+    return TRUE;
+  if (lmem->failed)
+    return FALSE;
+
+  gst_allocation_params_init (&params);
+  params.align = LAZY_ALIGN;
+  lmem->backing = gst_allocator_alloc (NULL, lmem->mem.maxsize, &params);
+  if (!lmem->backing || !gst_memory_map (lmem->backing, &lmem->backing_map,
+          GST_MAP_READWRITE)) {
+    GST_ERROR ("Failed to allocate %" G_GSIZE_FORMAT " bytes for a lazily "
+        "decoded frame", lmem->mem.maxsize);
+    goto failed;
+  }
+
+  if (!gst_buffer_map (lmem->input, &input, GST_MAP_READ)) {
+    GST_ERROR ("Failed to map the compressed frame");
+    gst_memory_unmap (lmem->backing, &lmem->backing_map);
+    goto failed;
+  }
+  ok = lmem->decode (lmem->user_data, &input, lmem->backing_map.data,
+      lmem->backing_map.size);
+  gst_buffer_unmap (lmem->input, &input);
+
+  if (!ok) {
+    GST_ERROR ("Failed to decode frame on map");
+    gst_memory_unmap (lmem->backing, &lmem->backing_map);
+    goto failed;
+  }
+
+  GST_LOG ("Decoded lazy memory %p", lmem);
+  gst_buffer_replace (&lmem->input, NULL);
+  return TRUE;
+
+failed:
+  if (lmem->backing)
+    gst_memory_unref (lmem->backing);
+  lmem->backing = NULL;
+  lmem->failed = TRUE;
+  return FALSE;
+}
+
+static gpointer
+gst_turbojpeg_lazy_mem_map (GstMemory * mem, gsize maxsize, GstMapFlags flags)
+{
+  GstTurboJpegLazyMemory *root = gst_turbojpeg_lazy_memory_root (mem);
+  gpointer data = NULL;
+
+  g_mutex_lock (&root->lock);
+  if (gst_turbojpeg_lazy_memory_decode (root))
+    data = root->backing_map.data;
+  g_mutex_unlock (&root->lock);
+
+  return data;
+}
+
+static void
+gst_turbojpeg_lazy_mem_unmap (GstMemory * mem)
+{
+}
+
+/* Copies decode the frame first, and are plain system memory */
+static GstMemory *
+gst_turbojpeg_lazy_mem_copy (GstMemory * mem, gssize offset, gssize size)
+{
+  GstMemory *copy;
+  GstMapInfo src, dst;
+
+  if (size == -1)
+    size = mem->size > (gsize) offset ? mem->size - offset : 0;
+
+  if (!gst_memory_map (mem, &src, GST_MAP_READ))
+    return NULL;
+
+  copy = gst_allocator_alloc (NULL, size, NULL);
+  if (copy && gst_memory_map (copy, &dst, GST_MAP_WRITE)) {
+    memcpy (dst.data, src.data + offset, size);
+    gst_memory_unmap (copy, &dst);
+  } else if (copy) {
+    gst_memory_unref (copy);
+    copy = NULL;
+  }
+  gst_memory_unmap (mem, &src);
+
+  return copy;
+}
+
+static GstMemory *
+gst_turbojpeg_lazy_mem_share (GstMemory * mem, gssize offset, gssize size)
+{
+  GstTurboJpegLazyMemory *root = gst_turbojpeg_lazy_memory_root (mem);
+  GstTurboJpegLazyMemory *share;
+
+  if (size == -1)
+    size = mem->size - offset;
+
+  share = g_slice_new0 (GstTurboJpegLazyMemory);
+  gst_memory_init (GST_MEMORY_CAST (share),
+      GST_MINI_OBJECT_FLAGS (root) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+      mem->allocator, GST_MEMORY_CAST (root), mem->maxsize, mem->align,
+      mem->offset + offset, size);
+
+  return GST_MEMORY_CAST (share);
+}
+
+static gboolean
+gst_turbojpeg_lazy_mem_is_span (GstMemory * mem1, GstMemory * mem2,
+    gsize * offset)
+{
+  return FALSE;
+}
+
+static GstMemory *
+gst_turbojpeg_lazy_allocator_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  /* Lazy memories only come from gst_turbojpeg_lazy_memory_new() */
+  return NULL;
+}
+
+static void
+gst_turbojpeg_lazy_allocator_free (GstAllocator * allocator, GstMemory * mem)
+{
+  GstTurboJpegLazyMemory *lmem = (GstTurboJpegLazyMemory *) mem;
+
+  /* Shares only hold their root, which the core releases */
+  if (!mem->parent) {
+    if (lmem->backing) {
+      gst_memory_unmap (lmem->backing, &lmem->backing_map);
+      gst_memory_unref (lmem->backing);
+    }
+    gst_buffer_replace (&lmem->input, NULL);
+    if (lmem->notify)
+      lmem->notify (lmem->user_data);
+    g_mutex_clear (&lmem->lock);
+  }
+
+  g_slice_free (GstTurboJpegLazyMemory, lmem);
+}
+
+static void
+gst_turbojpeg_lazy_allocator_class_init (GstTurboJpegLazyAllocatorClass * klass)
+{
+  GstAllocatorClass *allocator_class = (GstAllocatorClass *) klass;
+
+  allocator_class->alloc = gst_turbojpeg_lazy_allocator_alloc;
+  allocator_class->free = gst_turbojpeg_lazy_allocator_free;
+
+  GST_DEBUG_CATEGORY_INIT (gst_turbojpeg_lazy_debug, "turbojpeglazy", 0,
+      "TurboJPEG decode-on-map memory");
+}
+
+static void
+gst_turbojpeg_lazy_allocator_init (GstTurboJpegLazyAllocator * allocator)
+{
+  GstAllocator *alloc = GST_ALLOCATOR_CAST (allocator);
+
+  alloc->mem_type = GST_TURBOJPEG_LAZY_MEMORY_TYPE;
+  alloc->mem_map = gst_turbojpeg_lazy_mem_map;
+  alloc->mem_unmap = gst_turbojpeg_lazy_mem_unmap;
+  alloc->mem_copy = gst_turbojpeg_lazy_mem_copy;
+  alloc->mem_share = gst_turbojpeg_lazy_mem_share;
+  alloc->mem_is_span = gst_turbojpeg_lazy_mem_is_span;
+
+  GST_OBJECT_FLAG_SET (allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+/* Create @size bytes of memory that run @decode on the JPEG in @input when
+ * first mapped. @notify is called on @user_data once the memory is freed */
+GstMemory *
+gst_turbojpeg_lazy_memory_new (GstBuffer * input, gsize size,
+    GstTurboJpegLazyDecodeFunc decode, gpointer user_data,
+    GDestroyNotify notify)
+{
+  GstTurboJpegLazyMemory *lmem;
+
+  if (g_once_init_enter (&lazy_allocator)) {
+    GstAllocator *allocator =
+        g_object_new (GST_TYPE_TURBOJPEG_LAZY_ALLOCATOR, NULL);
+
+    gst_object_ref_sink (allocator);
+    g_once_init_leave (&lazy_allocator, allocator);
+  }
+
+  lmem = g_slice_new0 (GstTurboJpegLazyMemory);
+  gst_memory_init (GST_MEMORY_CAST (lmem), 0, lazy_allocator, NULL, size,
+      LAZY_ALIGN, 0, size);
+  g_mutex_init (&lmem->lock);
+  lmem->input = gst_buffer_ref (input);
+  lmem->decode = decode;
+  lmem->user_data = user_data;
+  lmem->notify = notify;
+
+  return GST_MEMORY_CAST (lmem);
+}
+
+gboolean
+gst_is_turbojpeg_lazy_memory (GstMemory * mem)
+{
+  return mem != NULL && mem->allocator != NULL &&
+      g_type_is_a (G_OBJECT_TYPE (mem->allocator),
+      GST_TYPE_TURBOJPEG_LAZY_ALLOCATOR);
+}
+
+/* Whether the frame behind @mem has been decoded yet */
+gboolean
+gst_turbojpeg_lazy_memory_is_decoded (GstMemory * mem)
+{
+  GstTurboJpegLazyMemory *root = gst_turbojpeg_lazy_memory_root (mem);
+  gboolean decoded;
+
+  g_mutex_lock (&root->lock);
+  decoded = root->backing != NULL;
+  g_mutex_unlock (&root->lock);
+
+  return decoded;
+}
@@ -0,0 +1,60 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_LAZY_H__
+#define __GST_TURBOJPEG_LAZY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TURBOJPEG_LAZY_MEMORY_TYPE "TurboJpegLazy"
+
+#define GST_TYPE_TURBOJPEG_LAZY_ALLOCATOR \
+  (gst_turbojpeg_lazy_allocator_get_type())
+
+typedef struct _GstTurboJpegLazyAllocator GstTurboJpegLazyAllocator;
+typedef struct _GstTurboJpegLazyAllocatorClass GstTurboJpegLazyAllocatorClass;
+
+/* Decodes the JPEG in @input into the @size bytes at @data. Returns FALSE
+ * only if nothing could be written there, failing the map */
+typedef gboolean (*GstTurboJpegLazyDecodeFunc) (gpointer user_data,
+    GstMapInfo * input, guint8 * data, gsize size);
+
+struct _GstTurboJpegLazyAllocator
+{
+  GstAllocator parent;
+};
+
+struct _GstTurboJpegLazyAllocatorClass
+{
+  GstAllocatorClass parent_class;
+};
+
+GType gst_turbojpeg_lazy_allocator_get_type (void);
+
+GstMemory *gst_turbojpeg_lazy_memory_new (GstBuffer * input, gsize size,
+    GstTurboJpegLazyDecodeFunc decode, gpointer user_data,
+    GDestroyNotify notify);
+gboolean gst_is_turbojpeg_lazy_memory (GstMemory * mem);
+gboolean gst_turbojpeg_lazy_memory_is_decoded (GstMemory * mem);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_LAZY_H__ */
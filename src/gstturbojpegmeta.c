@@ -0,0 +1,129 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/video/video.h>
+
+#include "gstturbojpegmeta.h"
+
+GType
+gst_turbojpeg_block_meta_api_get_type (void)
+{
+  static GType type = 0;
+  static const gchar *tags[] = { GST_META_TAG_VIDEO_STR, NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type =
+        gst_meta_api_type_register ("GstTurboJpegBlockMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_turbojpeg_block_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstTurboJpegBlockMeta *bmeta = (GstTurboJpegBlockMeta *) meta;
+
+  bmeta->width = bmeta->height = 0;
+  bmeta->block_size = 8;
+  bmeta->dc = NULL;
+  bmeta->ac_energy = NULL;
+
+  return TRUE;
+}
+
+static void
+gst_turbojpeg_block_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstTurboJpegBlockMeta *bmeta = (GstTurboJpegBlockMeta *) meta;
+
+  g_free (bmeta->dc);
+  g_free (bmeta->ac_energy);
+}
+
+/* The maps describe the picture, so they follow it through copies and
+ * the decoder, but not through scaling or cropping of the raw video */
+static gboolean
+gst_turbojpeg_block_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstTurboJpegBlockMeta *bmeta = (GstTurboJpegBlockMeta *) meta;
+  GstTurboJpegBlockMeta *dmeta;
+  gsize n_blocks = (gsize) bmeta->width * bmeta->height;
+
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  dmeta = gst_buffer_add_turbojpeg_block_meta (dest, bmeta->width,
+      bmeta->height, bmeta->ac_energy != NULL);
+  if (!dmeta)
+    return FALSE;
+
+  dmeta->block_size = bmeta->block_size;
+  memcpy (dmeta->dc, bmeta->dc, n_blocks);
+  if (bmeta->ac_energy)
+    memcpy (dmeta->ac_energy, bmeta->ac_energy, n_blocks * sizeof (guint32));
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_turbojpeg_block_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_TURBOJPEG_BLOCK_META_API_TYPE,
+        "GstTurboJpegBlockMeta", sizeof (GstTurboJpegBlockMeta),
+        gst_turbojpeg_block_meta_init, gst_turbojpeg_block_meta_free,
+        gst_turbojpeg_block_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+/* Attach zeroed maps of @width x @height blocks to @buffer */
+GstTurboJpegBlockMeta *
+gst_buffer_add_turbojpeg_block_meta (GstBuffer * buffer, guint width,
+    guint height, gboolean ac_energy)
+{
+  GstTurboJpegBlockMeta *meta;
+  gsize n_blocks = (gsize) width * height;
+
+  meta = (GstTurboJpegBlockMeta *) gst_buffer_add_meta (buffer,
+      GST_TURBOJPEG_BLOCK_META_INFO, NULL);
+  if (!meta)
+    return NULL;
+
+  meta->width = width;
+  meta->height = height;
+  meta->dc = g_malloc0 (n_blocks);
+  if (ac_energy)
+    meta->ac_energy = g_new0 (guint32, n_blocks);
+
+  return meta;
+}
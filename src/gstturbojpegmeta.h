@@ -0,0 +1,70 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_META_H__
+#define __GST_TURBOJPEG_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TURBOJPEG_BLOCK_META_API_TYPE \
+  (gst_turbojpeg_block_meta_api_get_type())
+#define GST_TURBOJPEG_BLOCK_META_INFO \
+  (gst_turbojpeg_block_meta_get_info())
+
+typedef struct _GstTurboJpegBlockMeta GstTurboJpegBlockMeta;
+
+/**
+ * GstTurboJpegBlockMeta:
+ * @meta: parent #GstMeta
+ * @width: luma blocks per row
+ * @height: rows of luma blocks
+ * @block_size: image pixels covered by a block side, 8 unless the luma is
+ *     subsampled
+ * @dc: mean luma of every block, 0-255, @width * @height in raster order
+ * @ac_energy: sum of the absolute dequantised AC coefficients of every
+ *     block, or %NULL when not requested
+ *
+ * A 1/8-scale luma thumbnail and activity map of a JPEG, read from its DCT
+ * coefficients without an inverse DCT.
+ */
+struct _GstTurboJpegBlockMeta
+{
+  GstMeta meta;
+
+  guint width;
+  guint height;
+  guint block_size;
+  guint8 *dc;
+  guint32 *ac_energy;
+};
+
+GType gst_turbojpeg_block_meta_api_get_type (void);
+const GstMetaInfo *gst_turbojpeg_block_meta_get_info (void);
+
+#define gst_buffer_get_turbojpeg_block_meta(b) ((GstTurboJpegBlockMeta *) \
+    gst_buffer_get_meta ((b), GST_TURBOJPEG_BLOCK_META_API_TYPE))
+
+GstTurboJpegBlockMeta *gst_buffer_add_turbojpeg_block_meta (GstBuffer *
+    buffer, guint width, guint height, gboolean ac_energy);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_META_H__ */
@@ -0,0 +1,632 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstturbojpegscan.h"
+
+#define READ_UINT16(p) ((guint) (((p)[0] << 8) | (p)[1]))
+
+#define MARKER_SOI 0xD8
+#define MARKER_EOI 0xD9
+#define MARKER_SOS 0xDA
+#define MARKER_DQT 0xDB
+#define MARKER_DRI 0xDD
+#define MARKER_APP0 0xE0
+#define MARKER_APP1 0xE1
+#define MARKER_APP14 0xEE
+#define MARKER_COM 0xFE
+
+#define IS_RST(m) ((m) >= 0xD0 && (m) <= 0xD7)
+#define IS_APP(m) ((m) >= 0xE0 && (m) <= 0xEF)
+/* SOF0..SOF15, excluding DHT (C4), JPG (C8) and DAC (CC) */
+#define IS_SOF(m) ((m) >= 0xC0 && (m) <= 0xCF && (m) != 0xC4 && \
+    (m) != 0xC8 && (m) != 0xCC)
+
+/* Natural position of the coefficients in zig-zag order */
+static const guint8 natural_order[64] = {
+  0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* A DQT segment may define several tables, of 8- or 16-bit entries */
+static gboolean
+gst_turbojpeg_parse_dqt (const guint8 * seg, guint len,
+    GstTurboJpegScanInfo * info)
+{
+  guint pos = 0;
+  gint k;
+
+  while (pos < len) {
+    gboolean wide = seg[pos] >> 4;
+    guint index = seg[pos] & 0x0F;
+
+    if (index > 3 || pos + 1 + (wide ? 128 : 64) > len)
+      return FALSE;
+    pos++;
+
+    for (k = 0; k < 64; k++) {
+      info->quant[index][natural_order[k]] = wide ?
+          READ_UINT16 (seg + pos + 2 * k) : seg[pos + k];
+    }
+    info->quant_tables |= 1 << index;
+    pos += wide ? 128 : 64;
+  }
+
+  return TRUE;
+}
+
+/* Walk the marker segments of a JPEG up to the first SOS and record the
+ * frame layout. Returns FALSE on malformed or truncated headers */
+gboolean
+gst_turbojpeg_scan_headers (const guint8 * data, gsize size,
+    GstTurboJpegScanInfo * info)
+{
+  gsize pos = 2;
+
+  memset (info, 0, sizeof (*info));
+
+  if (size < 4 || data[0] != 0xFF || data[1] != MARKER_SOI)
+    return FALSE;
+
+  while (pos + 4 <= size) {
+    const guint8 *seg;
+    guint8 marker;
+    guint len;
+
+    if (data[pos] != 0xFF)
+      return FALSE;
+
+    /* Any number of 0xFF fill bytes may precede a marker */
+    while (pos + 2 < size && data[pos + 1] == 0xFF)
+      pos++;
+    if (pos + 4 > size)
+      return FALSE;
+
+    marker = data[pos + 1];
+    if (marker == MARKER_EOI)
+      return FALSE;
+    if (IS_RST (marker) || marker == 0x01) {
+      pos += 2;
+      continue;
+    }
+
+    len = READ_UINT16 (data + pos + 2);
+    if (len < 2 || pos + 2 + len > size)
+      return FALSE;
+    seg = data + pos + 4;
+
+    if (IS_SOF (marker)) {
+      gint i;
+
+      if (len < 8)
+        return FALSE;
+
+      info->sof_marker = marker;
+      info->sof_offset = pos;
+      info->precision = seg[0];
+      info->height = READ_UINT16 (seg + 1);
+      info->width = READ_UINT16 (seg + 3);
+      info->n_components = seg[5];
+
+      if (info->n_components < 1 ||
+          info->n_components > GST_TURBOJPEG_MAX_COMPONENTS ||
+          len < 8 + 3 * (guint) info->n_components)
+        return FALSE;
+
+      info->max_h_samp = info->max_v_samp = 1;
+      for (i = 0; i < info->n_components; i++) {
+        info->h_samp[i] = seg[6 + 3 * i + 1] >> 4;
+        info->v_samp[i] = seg[6 + 3 * i + 1] & 0x0F;
+        info->quant_index[i] = seg[6 + 3 * i + 2] & 0x03;
+        if (info->h_samp[i] < 1 || info->h_samp[i] > 4 ||
+            info->v_samp[i] < 1 || info->v_samp[i] > 4)
+          return FALSE;
+        info->max_h_samp = MAX (info->max_h_samp, info->h_samp[i]);
+        info->max_v_samp = MAX (info->max_v_samp, info->v_samp[i]);
+      }
+    } else if (marker == MARKER_DQT) {
+      if (!gst_turbojpeg_parse_dqt (seg, len - 2, info))
+        return FALSE;
+    } else if (marker == MARKER_DRI) {
+      if (len < 4)
+        return FALSE;
+      info->restart_interval = READ_UINT16 (seg);
+    } else if (marker == MARKER_SOS) {
+      if (!info->sof_marker || len < 3)
+        return FALSE;
+      info->n_scan_components = seg[0];
+      info->scan_offset = pos + 2 + len;
+      return TRUE;
+    }
+
+    pos += 2 + len;
+  }
+
+  return FALSE;
+}
+
+/* Segments that decide how a frame decodes: everything but comments and
+ * application data, except the Adobe segment selecting the colour
+ * transform */
+static gboolean
+gst_turbojpeg_fingerprint_segment (guint8 marker)
+{
+  if (marker == MARKER_COM)
+    return FALSE;
+  if (IS_APP (marker))
+    return marker == MARKER_APP14;
+  return TRUE;
+}
+
+/* Compare the header segments of @data, up to and including the first SOS
+ * header, with those recorded in @key by the previous call, and record
+ * them in their place. Returns TRUE if they are identical, in which case
+ * anything parsed from the previous header still holds. Steady-state
+ * streams pay a single memcmp instead of a full header parse */
+gboolean
+gst_turbojpeg_header_fingerprint (const guint8 * data, gsize size,
+    GByteArray * key)
+{
+  gboolean same = TRUE;
+  gsize pos = 2;
+  guint off = 0;
+
+  if (size < 4 || data[0] != 0xFF || data[1] != MARKER_SOI)
+    goto invalid;
+
+  while (pos + 4 <= size) {
+    guint8 marker;
+    guint len;
+
+    if (data[pos] != 0xFF)
+      goto invalid;
+    while (pos + 2 < size && data[pos + 1] == 0xFF)
+      pos++;
+    if (pos + 4 > size)
+      goto invalid;
+
+    marker = data[pos + 1];
+    if (marker == MARKER_EOI)
+      goto invalid;
+    if (IS_RST (marker) || marker == 0x01) {
+      pos += 2;
+      continue;
+    }
+
+    len = READ_UINT16 (data + pos + 2);
+    if (len < 2 || pos + 2 + len > size)
+      goto invalid;
+
+    if (gst_turbojpeg_fingerprint_segment (marker)) {
+      if (same && off + 2 + len <= key->len &&
+          memcmp (key->data + off, data + pos, 2 + len) == 0) {
+        off += 2 + len;
+      } else {
+        if (same) {
+          g_byte_array_set_size (key, off);
+          same = FALSE;
+        }
+        g_byte_array_append (key, data + pos, 2 + len);
+        off += 2 + len;
+      }
+    }
+
+    if (marker == MARKER_SOS) {
+      if (same && off != key->len) {
+        g_byte_array_set_size (key, off);
+        same = FALSE;
+      }
+      return same;
+    }
+
+    pos += 2 + len;
+  }
+
+invalid:
+  g_byte_array_set_size (key, 0);
+  return FALSE;
+}
+
+#define EXIF_TAG_ORIENTATION 0x0112
+#define EXIF_TYPE_SHORT 3
+
+static guint
+gst_turbojpeg_exif_read (const guint8 * p, gint bytes, gboolean big_endian)
+{
+  guint v = 0;
+  gint i;
+
+  for (i = 0; i < bytes; i++)
+    v |= (guint) p[big_endian ? i : bytes - 1 - i] << (8 * (bytes - 1 - i));
+  return v;
+}
+
+/* Look up the orientation tag in IFD0 of the EXIF segment. Returns the
+ * orientation, 1..8, or 0 if there is none. @offset receives the position
+ * of its 16-bit value in @data and @big_endian the TIFF byte order, so the
+ * tag can be rewritten in place */
+gint
+gst_turbojpeg_exif_orientation (const guint8 * data, gsize size,
+    gsize * offset, gboolean * big_endian)
+{
+  gsize pos = 2;
+
+  if (size < 4 || data[0] != 0xFF || data[1] != MARKER_SOI)
+    return 0;
+
+  while (pos + 4 <= size) {
+    const guint8 *tiff;
+    guint8 marker;
+    guint len, n_entries, i;
+    gsize tiff_len, ifd;
+    gboolean be;
+
+    if (data[pos] != 0xFF)
+      return 0;
+    while (pos + 2 < size && data[pos + 1] == 0xFF)
+      pos++;
+    if (pos + 4 > size)
+      return 0;
+
+    marker = data[pos + 1];
+    if (marker == MARKER_EOI || marker == MARKER_SOS)
+      return 0;
+    if (IS_RST (marker) || marker == 0x01) {
+      pos += 2;
+      continue;
+    }
+
+    len = READ_UINT16 (data + pos + 2);
+    if (len < 2 || pos + 2 + len > size)
+      return 0;
+
+    if (marker != MARKER_APP1 || len < 2 + 6 + 8 ||
+        memcmp (data + pos + 4, "Exif\0\0", 6) != 0) {
+      pos += 2 + len;
+      continue;
+    }
+
+    tiff = data + pos + 10;
+    tiff_len = len - 8;
+    if (tiff[0] == 'M' && tiff[1] == 'M')
+      be = TRUE;
+    else if (tiff[0] == 'I' && tiff[1] == 'I')
+      be = FALSE;
+    else
+      return 0;
+
+    ifd = gst_turbojpeg_exif_read (tiff + 4, 4, be);
+    if (ifd > tiff_len || tiff_len - ifd < 2)
+      return 0;
+    n_entries = gst_turbojpeg_exif_read (tiff + ifd, 2, be);
+
+    for (i = 0; i < n_entries; i++) {
+      const guint8 *entry = tiff + ifd + 2 + 12 * i;
+      guint orientation;
+
+      if (12 * (gsize) (i + 1) > tiff_len - ifd - 2)
+        return 0;
+      if (gst_turbojpeg_exif_read (entry, 2, be) != EXIF_TAG_ORIENTATION)
+        continue;
+      if (gst_turbojpeg_exif_read (entry + 2, 2, be) != EXIF_TYPE_SHORT)
+        return 0;
+
+      orientation = gst_turbojpeg_exif_read (entry + 8, 2, be);
+      if (orientation < 1 || orientation > 8)
+        return 0;
+      *offset = entry + 8 - data;
+      *big_endian = be;
+      return orientation;
+    }
+    return 0;
+  }
+
+  return 0;
+}
+
+#define HASH_PRIME1 G_GUINT64_CONSTANT (0x9E3779B185EBCA87)
+#define HASH_PRIME2 G_GUINT64_CONSTANT (0xC2B2AE3D27D4EB4F)
+#define HASH_PRIME3 G_GUINT64_CONSTANT (0x165667B19E3779F9)
+#define HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline guint64
+gst_turbojpeg_hash_round (guint64 acc, guint64 v)
+{
+  acc += v * HASH_PRIME2;
+  acc = HASH_ROTL (acc, 31);
+  return acc * HASH_PRIME1;
+}
+
+static inline guint64
+gst_turbojpeg_hash_load (const guint8 * p)
+{
+  guint64 v;
+
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+/* 64-bit hash of a whole compressed frame, four independent lanes of
+ * multiply-rotate rounds so it runs at memory speed. Only meant to
+ * recognise repeated frames within one process, not to be stable across
+ * hosts */
+guint64
+gst_turbojpeg_hash (const guint8 * data, gsize size)
+{
+  guint64 acc[4] = { HASH_PRIME1 + HASH_PRIME2, HASH_PRIME2, 0,
+    -HASH_PRIME1
+  };
+  guint64 h, tail = 0;
+  gsize i = 0;
+  gint l;
+
+  for (; i + 32 <= size; i += 32) {
+    acc[0] = gst_turbojpeg_hash_round (acc[0],
+        gst_turbojpeg_hash_load (data + i));
+    acc[1] = gst_turbojpeg_hash_round (acc[1],
+        gst_turbojpeg_hash_load (data + i + 8));
+    acc[2] = gst_turbojpeg_hash_round (acc[2],
+        gst_turbojpeg_hash_load (data + i + 16));
+    acc[3] = gst_turbojpeg_hash_round (acc[3],
+        gst_turbojpeg_hash_load (data + i + 24));
+  }
+
+  h = HASH_ROTL (acc[0], 1) + HASH_ROTL (acc[1], 7) + HASH_ROTL (acc[2], 12) +
+      HASH_ROTL (acc[3], 18);
+  for (l = 0; l < 4; l++)
+    h = (h ^ gst_turbojpeg_hash_round (0, acc[l])) * HASH_PRIME1 + HASH_PRIME3;
+
+  for (; i + 8 <= size; i += 8)
+    h = HASH_ROTL (h ^ gst_turbojpeg_hash_round (0,
+            gst_turbojpeg_hash_load (data + i)), 27) * HASH_PRIME1 + HASH_PRIME3;
+  for (l = 0; i < size; i++, l += 8)
+    tail |= (guint64) data[i] << l;
+
+  h ^= gst_turbojpeg_hash_round (0, tail) ^ size;
+  h ^= h >> 33;
+  h *= HASH_PRIME2;
+  h ^= h >> 29;
+  h *= HASH_PRIME3;
+  return h ^ (h >> 32);
+}
+
+static guint
+gst_turbojpeg_gcd (guint a, guint b)
+{
+  while (b) {
+    guint t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* Only the segments libjpeg needs to decode the frame are copied into the
+ * band JPEGs: APP0 (JFIF) and APP14 (Adobe) still influence the colour
+ * transform, other application segments and comments are dropped */
+static gboolean
+gst_turbojpeg_keep_segment (guint8 marker)
+{
+  if (marker == MARKER_COM)
+    return FALSE;
+  if (IS_APP (marker))
+    return marker == MARKER_APP0 || marker == MARKER_APP14;
+  return TRUE;
+}
+
+static void
+gst_turbojpeg_append_band_header (GByteArray * storage, const guint8 * data,
+    const GstTurboJpegScanInfo * info, gint height)
+{
+  static const guint8 soi[] = { 0xFF, MARKER_SOI };
+  gsize pos = 2;
+
+  g_byte_array_append (storage, soi, sizeof (soi));
+
+  /* Headers were validated by gst_turbojpeg_scan_headers() */
+  while (pos < info->scan_offset) {
+    guint8 marker;
+    guint len;
+
+    while (data[pos + 1] == 0xFF)
+      pos++;
+    marker = data[pos + 1];
+    if (IS_RST (marker) || marker == 0x01) {
+      pos += 2;
+      continue;
+    }
+    len = READ_UINT16 (data + pos + 2);
+
+    if (gst_turbojpeg_keep_segment (marker)) {
+      guint start = storage->len;
+
+      g_byte_array_append (storage, data + pos, 2 + len);
+      if (pos == info->sof_offset) {
+        /* Band height replaces the frame height (SOF bytes 5-6) */
+        storage->data[start + 5] = (height >> 8) & 0xFF;
+        storage->data[start + 6] = height & 0xFF;
+      }
+    }
+    pos += 2 + len;
+  }
+}
+
+/* Copy entropy-coded data, renumbering RSTn markers so that each band
+ * starts again at RST0 as a standalone image would */
+static void
+gst_turbojpeg_append_band_scan (GByteArray * storage, const guint8 * data,
+    gsize start, gsize end)
+{
+  static const guint8 eoi[] = { 0xFF, MARKER_EOI };
+  guint rst = 0;
+  gsize pos = start;
+
+  while (pos < end) {
+    const guint8 *ff = memchr (data + pos, 0xFF, end - pos);
+    gsize next = ff ? (gsize) (ff - data) : end;
+
+    g_byte_array_append (storage, data + pos, next - pos);
+    pos = next;
+    if (pos >= end)
+      break;
+
+    if (pos + 1 < end && IS_RST (data[pos + 1])) {
+      guint8 marker[2] = { 0xFF, 0xD0 + (rst++ & 7) };
+      g_byte_array_append (storage, marker, 2);
+      pos += 2;
+    } else {
+      g_byte_array_append (storage, data + pos, 1);
+      pos++;
+    }
+  }
+
+  g_byte_array_append (storage, eoi, sizeof (eoi));
+}
+
+/* Split a baseline, single-scan JPEG with restart markers into up to
+ * @max_bands standalone JPEGs covering consecutive MCU rows. Bands can only
+ * start at restart markers that fall on an MCU row boundary, since DC
+ * prediction is only reset there. The band JPEGs are written to @storage.
+ * Returns the number of bands, or 0 if the image cannot be split */
+gint
+gst_turbojpeg_split_restart_bands (const guint8 * data, gsize size,
+    const GstTurboJpegScanInfo * info, gint max_bands, GByteArray * storage,
+    GstTurboJpegBand * bands)
+{
+  gsize starts[GST_TURBOJPEG_MAX_BANDS + 1];
+  guint boundaries[GST_TURBOJPEG_MAX_BANDS];
+  gint rows[GST_TURBOJPEG_MAX_BANDS + 1];
+  guint mcu_w, mcu_h, mcus_per_row, mcu_rows, step, rows_per_step;
+  guint interval, next;
+  gint n_bands, b;
+  gsize pos, eoi;
+
+  if (info->sof_marker != 0xC0 && info->sof_marker != 0xC1)
+    return 0;
+  if (info->restart_interval == 0 || info->height <= 0 || info->width <= 0)
+    return 0;
+  if (info->n_scan_components != info->n_components)
+    return 0;
+
+  max_bands = MIN (max_bands, GST_TURBOJPEG_MAX_BANDS);
+  if (max_bands < 2)
+    return 0;
+
+  /* A single-component scan is not interleaved: one block per MCU */
+  if (info->n_components == 1) {
+    mcu_w = mcu_h = 8;
+  } else {
+    mcu_w = 8 * info->max_h_samp;
+    mcu_h = 8 * info->max_v_samp;
+  }
+  mcus_per_row = (info->width + mcu_w - 1) / mcu_w;
+  mcu_rows = (info->height + mcu_h - 1) / mcu_h;
+
+  /* Number of restart intervals between markers that start an MCU row */
+  step = mcus_per_row / gst_turbojpeg_gcd (info->restart_interval,
+      mcus_per_row);
+  rows_per_step = step * info->restart_interval / mcus_per_row;
+  if (rows_per_step >= mcu_rows)
+    return 0;
+
+  n_bands = MIN ((guint) max_bands, mcu_rows / rows_per_step);
+
+  /* Pick the usable restart marker closest to an even split */
+  rows[0] = 0;
+  next = 0;
+  for (b = 1; b < n_bands; b++) {
+    guint row = (b * mcu_rows / n_bands + rows_per_step - 1) / rows_per_step *
+        rows_per_step;
+
+    if (row >= mcu_rows)
+      break;
+    if (row <= (guint) rows[next])
+      continue;
+    next++;
+    rows[next] = row;
+    boundaries[next - 1] = row / rows_per_step * step;
+  }
+  n_bands = next + 1;
+  if (n_bands < 2)
+    return 0;
+
+  /* Locate the chosen restart markers and the end of the scan */
+  starts[0] = info->scan_offset;
+  interval = 0;
+  next = 0;
+  eoi = 0;
+  pos = info->scan_offset;
+  while (pos + 1 < size) {
+    const guint8 *ff = memchr (data + pos, 0xFF, size - pos - 1);
+    guint8 marker;
+
+    if (!ff)
+      break;
+    pos = ff - data;
+    marker = data[pos + 1];
+
+    if (marker == 0x00 || marker == 0xFF) {
+      pos++;
+      continue;
+    }
+    if (IS_RST (marker)) {
+      interval++;
+      if (next < (guint) n_bands - 1 && interval == boundaries[next]) {
+        next++;
+        starts[next] = pos + 2;
+      }
+      pos += 2;
+      continue;
+    }
+
+    /* Anything else ends the scan; it must be the only one */
+    if (marker == MARKER_EOI)
+      eoi = pos;
+    break;
+  }
+
+  if (!eoi || next != (guint) n_bands - 1)
+    return 0;
+  starts[n_bands] = eoi + 2;
+
+  g_byte_array_set_size (storage, 0);
+  for (b = 0; b < n_bands; b++) {
+    gint y = rows[b] * mcu_h;
+    gint end_y = b + 1 < n_bands ? rows[b + 1] * (gint) mcu_h : info->height;
+
+    bands[b].offset = storage->len;
+    bands[b].y = y;
+    bands[b].height = MIN (end_y, info->height) - y;
+
+    gst_turbojpeg_append_band_header (storage, data, info, bands[b].height);
+    /* Drop the RST marker that separates this band from the next one */
+    gst_turbojpeg_append_band_scan (storage, data, starts[b],
+        starts[b + 1] - 2);
+    bands[b].size = storage->len - bands[b].offset;
+  }
+
+  return n_bands;
+}
@@ -0,0 +1,81 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_SCAN_H__
+#define __GST_TURBOJPEG_SCAN_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TURBOJPEG_MAX_COMPONENTS 4
+#define GST_TURBOJPEG_MAX_BANDS 64
+
+/* Frame layout gathered by a lightweight walk over the JPEG marker
+ * segments, up to and including the first SOS */
+typedef struct
+{
+  guint8 sof_marker;          /* SOFn marker code (0xC0..0xCF) */
+  gint precision;
+  gint width;
+  gint height;
+  gint n_components;
+  gint h_samp[GST_TURBOJPEG_MAX_COMPONENTS];
+  gint v_samp[GST_TURBOJPEG_MAX_COMPONENTS];
+  gint max_h_samp;
+  gint max_v_samp;
+
+  guint restart_interval;     /* MCUs per restart interval, 0 if none */
+
+  guint quant_tables;         /* Mask of the quantisation tables defined */
+  guint16 quant[4][64];       /* Quantisation tables, in natural order */
+  gint quant_index[GST_TURBOJPEG_MAX_COMPONENTS]; /* Table of each component */
+
+  gsize sof_offset;           /* Offset of the SOF marker */
+  gint n_scan_components;     /* Components in the first scan */
+  gsize scan_offset;          /* First byte of entropy-coded data */
+} GstTurboJpegScanInfo;
+
+/* One horizontal band of an image, re-wrapped as a standalone JPEG */
+typedef struct
+{
+  gsize offset;               /* Offset of the band JPEG in the storage */
+  gsize size;
+  gint y;                     /* First image row covered by the band */
+  gint height;
+} GstTurboJpegBand;
+
+gboolean gst_turbojpeg_scan_headers (const guint8 * data, gsize size,
+    GstTurboJpegScanInfo * info);
+
+gboolean gst_turbojpeg_header_fingerprint (const guint8 * data, gsize size,
+    GByteArray * key);
+
+gint gst_turbojpeg_exif_orientation (const guint8 * data, gsize size,
+    gsize * offset, gboolean * big_endian);
+
+guint64 gst_turbojpeg_hash (const guint8 * data, gsize size);
+
+gint gst_turbojpeg_split_restart_bands (const guint8 * data, gsize size,
+    const GstTurboJpegScanInfo * info, gint max_bands, GByteArray * storage,
+    GstTurboJpegBand * bands);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_SCAN_H__ */
@@ -0,0 +1,443 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <string.h>
+
+#include "gstturbojpegthumb.h"
+#include "gstturbojpegconvert.h"
+#include "gstturbojpegimage.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_turbojpeg_thumb_debug);
+#define GST_CAT_DEFAULT gst_turbojpeg_thumb_debug
+
+enum
+{
+  PROP_0,
+  PROP_WIDTH,
+  PROP_HEIGHT,
+  PROP_QUALITY,
+  PROP_SUBSAMPLING
+};
+
+#define DEFAULT_WIDTH 160
+#define DEFAULT_HEIGHT 120
+#define DEFAULT_QUALITY 75
+#define DEFAULT_SUBSAMPLING -1
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg")
+    );
+
+#define gst_turbojpeg_thumb_parent_class parent_class
+G_DEFINE_TYPE (GstTurboJpegThumb, gst_turbojpeg_thumb,
+    GST_TYPE_BASE_TRANSFORM);
+
+gboolean
+gst_turbojpeg_thumb_register (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, "turbojpegthumb", GST_RANK_NONE,
+      GST_TYPE_TURBOJPEG_THUMB);
+}
+
+static void gst_turbojpeg_thumb_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_turbojpeg_thumb_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_turbojpeg_thumb_start (GstBaseTransform * trans);
+static gboolean gst_turbojpeg_thumb_stop (GstBaseTransform * trans);
+static gboolean gst_turbojpeg_thumb_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
+static GstFlowReturn gst_turbojpeg_thumb_generate_output (GstBaseTransform *
+    trans, GstBuffer ** outbuf);
+
+static void
+gst_turbojpeg_thumb_class_init (GstTurboJpegThumbClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+  GstBaseTransformClass *trans_class;
+
+  gobject_class = (GObjectClass *) klass;
+  element_class = (GstElementClass *) klass;
+  trans_class = (GstBaseTransformClass *) klass;
+
+  gobject_class->set_property = gst_turbojpeg_thumb_set_property;
+  gobject_class->get_property = gst_turbojpeg_thumb_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_WIDTH,
+      g_param_spec_int ("width", "Width",
+          "Largest thumbnail width (0 = unconstrained). The image is scaled "
+          "down by the largest DCT scaling factor that fits",
+          0, G_MAXINT, DEFAULT_WIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_HEIGHT,
+      g_param_spec_int ("height", "Height",
+          "Largest thumbnail height (0 = unconstrained)",
+          0, G_MAXINT, DEFAULT_HEIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUALITY,
+      g_param_spec_int ("quality", "Quality",
+          "JPEG quality of the thumbnail (1-100)",
+          1, 100, DEFAULT_QUALITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SUBSAMPLING,
+      g_param_spec_int ("subsampling", "Chroma Subsampling",
+          "Chroma subsampling of the thumbnail (-1=same as the source, "
+          "0=4:4:4, 1=4:2:2, 2=4:2:0, 3=GRAY, 4=4:4:0)",
+          -1, 4, DEFAULT_SUBSAMPLING,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "TurboJPEG Thumbnailer", "Filter/Effect/Image",
+      "Re-encode JPEG images at a reduced size through DCT-domain scaling",
+      "GStreamer TurboJPEG Plugin");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_turbojpeg_thumb_start);
+  trans_class->stop = GST_DEBUG_FUNCPTR (gst_turbojpeg_thumb_stop);
+  trans_class->transform_caps =
+      GST_DEBUG_FUNCPTR (gst_turbojpeg_image_transform_caps);
+  trans_class->set_caps = GST_DEBUG_FUNCPTR (gst_turbojpeg_thumb_set_caps);
+  trans_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_turbojpeg_thumb_generate_output);
+
+  GST_DEBUG_CATEGORY_INIT (gst_turbojpeg_thumb_debug, "turbojpegthumb", 0,
+      "TurboJPEG thumbnailer");
+}
+
+static void
+gst_turbojpeg_thumb_init (GstTurboJpegThumb * thumb)
+{
+  thumb->tjInstanceDecode = NULL;
+  thumb->tjInstanceEncode = NULL;
+  thumb->arena = NULL;
+  thumb->width = DEFAULT_WIDTH;
+  thumb->height = DEFAULT_HEIGHT;
+  thumb->quality = DEFAULT_QUALITY;
+  thumb->subsampling = DEFAULT_SUBSAMPLING;
+}
+
+static void
+gst_turbojpeg_thumb_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstTurboJpegThumb *thumb = GST_TURBOJPEG_THUMB (object);
+
+  GST_OBJECT_LOCK (thumb);
+  switch (prop_id) {
+    case PROP_WIDTH:
+      thumb->width = g_value_get_int (value);
+      break;
+    case PROP_HEIGHT:
+      thumb->height = g_value_get_int (value);
+      break;
+    case PROP_QUALITY:
+      thumb->quality = g_value_get_int (value);
+      break;
+    case PROP_SUBSAMPLING:
+      thumb->subsampling = g_value_get_int (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (thumb);
+}
+
+static void
+gst_turbojpeg_thumb_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstTurboJpegThumb *thumb = GST_TURBOJPEG_THUMB (object);
+
+  GST_OBJECT_LOCK (thumb);
+  switch (prop_id) {
+    case PROP_WIDTH:
+      g_value_set_int (value, thumb->width);
+      break;
+    case PROP_HEIGHT:
+      g_value_set_int (value, thumb->height);
+      break;
+    case PROP_QUALITY:
+      g_value_set_int (value, thumb->quality);
+      break;
+    case PROP_SUBSAMPLING:
+      g_value_set_int (value, thumb->subsampling);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (thumb);
+}
+
+static gboolean
+gst_turbojpeg_thumb_start (GstBaseTransform * trans)
+{
+  GstTurboJpegThumb *thumb = GST_TURBOJPEG_THUMB (trans);
+
+  thumb->tjInstanceDecode = tj3Init (TJINIT_DECOMPRESS);
+  thumb->tjInstanceEncode = tj3Init (TJINIT_COMPRESS);
+  if (!thumb->tjInstanceDecode || !thumb->tjInstanceEncode) {
+    GST_ERROR_OBJECT (thumb, "Failed to initialize TurboJPEG instances");
+    return FALSE;
+  }
+  thumb->arena = gst_turbojpeg_arena_new ();
+  gst_turbojpeg_image_caps_reset (&thumb->out);
+
+  return TRUE;
+}
+
+static gboolean
+gst_turbojpeg_thumb_stop (GstBaseTransform * trans)
+{
+  GstTurboJpegThumb *thumb = GST_TURBOJPEG_THUMB (trans);
+
+  if (thumb->tjInstanceDecode) {
+    tj3Destroy (thumb->tjInstanceDecode);
+    thumb->tjInstanceDecode = NULL;
+  }
+  if (thumb->tjInstanceEncode) {
+    tj3Destroy (thumb->tjInstanceEncode);
+    thumb->tjInstanceEncode = NULL;
+  }
+  if (thumb->arena) {
+    gst_turbojpeg_arena_free (thumb->arena);
+    thumb->arena = NULL;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_turbojpeg_thumb_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstTurboJpegThumb *thumb = GST_TURBOJPEG_THUMB (trans);
+
+  gst_turbojpeg_image_caps_reset (&thumb->out);
+  return TRUE;
+}
+
+/* Largest downscaling factor whose output fits in @max_width x @max_height,
+ * or the smallest one if none does */
+static tjscalingfactor
+gst_turbojpeg_thumb_pick_scale (gint width, gint height, gint max_width,
+    gint max_height)
+{
+  tjscalingfactor best = { 1, 1 }, smallest = { 1, 1 };
+  tjscalingfactor *factors;
+  gboolean found = FALSE;
+  gint n_factors, i;
+
+  factors = tj3GetScalingFactors (&n_factors);
+  for (i = 0; factors && i < n_factors; i++) {
+    tjscalingfactor sf = factors[i];
+
+    if (sf.num > sf.denom)
+      continue;
+    if (sf.num * smallest.denom < smallest.num * sf.denom)
+      smallest = sf;
+    if ((max_width && TJSCALED (width, sf) > max_width) ||
+        (max_height && TJSCALED (height, sf) > max_height))
+      continue;
+    if (found && sf.num * best.denom <= best.num * sf.denom)
+      continue;
+    best = sf;
+    found = TRUE;
+  }
+
+  return found ? best : smallest;
+}
+
+static GstFlowReturn
+gst_turbojpeg_thumb_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstTurboJpegThumb *thumb = GST_TURBOJPEG_THUMB (trans);
+  GstBuffer *inbuf = trans->queued_buf;
+  GstTurboJpegChromaPlan chroma;
+  GstMapInfo map_info;
+  tjscalingfactor sf;
+  guint8 *scratch = NULL, *rows = NULL;
+  guint8 *src_planes[3] = { NULL, NULL, NULL };
+  guint8 *dst_planes[3] = { NULL, NULL, NULL };
+  gint src_strides[3] = { 0, 0, 0 }, src_heights[3] = { 0, 0, 0 };
+  gint dst_strides[3] = { 0, 0, 0 }, dst_heights[3] = { 0, 0, 0 };
+  gint max_width, max_height, quality, src_subsamp, dst_subsamp;
+  gint width, height, c;
+  gboolean resample = FALSE;
+  gsize size = 0;
+  guchar *dst = NULL;
+  size_t dst_size = 0;
+
+  trans->queued_buf = NULL;
+  *outbuf = NULL;
+  if (!inbuf)
+    return GST_FLOW_OK;
+
+  GST_OBJECT_LOCK (thumb);
+  max_width = thumb->width;
+  max_height = thumb->height;
+  quality = thumb->quality;
+  dst_subsamp = thumb->subsampling;
+  GST_OBJECT_UNLOCK (thumb);
+
+  if (!gst_buffer_map (inbuf, &map_info, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (thumb, "Failed to map input buffer");
+    gst_buffer_unref (inbuf);
+    return GST_FLOW_ERROR;
+  }
+
+  src_subsamp = gst_turbojpeg_image_read_yuv_header (thumb->tjInstanceDecode,
+      map_info.data, map_info.size);
+  if (src_subsamp == TJSAMP_UNKNOWN) {
+    GST_WARNING_OBJECT (thumb, "Invalid JPEG or not decodable to 8-bit YUV");
+    goto drop;
+  }
+
+  width = tj3Get (thumb->tjInstanceDecode, TJPARAM_JPEGWIDTH);
+  height = tj3Get (thumb->tjInstanceDecode, TJPARAM_JPEGHEIGHT);
+  sf = gst_turbojpeg_thumb_pick_scale (width, height, max_width, max_height);
+  tj3SetScalingFactor (thumb->tjInstanceDecode, sf);
+  width = TJSCALED (width, sf);
+  height = TJSCALED (height, sf);
+
+  if (dst_subsamp < 0)
+    dst_subsamp = src_subsamp;
+
+  /* Chroma only needs resampling between two colour subsamplings */
+  if (dst_subsamp != src_subsamp && dst_subsamp != TJSAMP_GRAY &&
+      src_subsamp != TJSAMP_GRAY) {
+    resample = gst_turbojpeg_chroma_plan_init (&chroma,
+        tjMCUWidth[src_subsamp] / 8, tjMCUHeight[src_subsamp] / 8,
+        tjMCUWidth[dst_subsamp] / 8, tjMCUHeight[dst_subsamp] / 8);
+    if (!resample) {
+      GST_WARNING_OBJECT (thumb, "No chroma conversion from subsampling %d "
+          "to %d, keeping the source's", src_subsamp, dst_subsamp);
+      dst_subsamp = src_subsamp;
+    }
+  }
+
+  /* One arena block holds the decoded planes, the re-encoded chroma planes
+   * and the resampling rows. The luma plane is always shared */
+  for (c = 0; c < (src_subsamp == TJSAMP_GRAY ? 1 : 3); c++) {
+    src_strides[c] = tj3YUVPlaneWidth (c, width, src_subsamp);
+    src_heights[c] = tj3YUVPlaneHeight (c, height, src_subsamp);
+    size += (gsize) src_strides[c] * src_heights[c];
+  }
+  for (c = 1; c < (dst_subsamp == TJSAMP_GRAY ? 1 : 3); c++) {
+    dst_strides[c] = tj3YUVPlaneWidth (c, width, dst_subsamp);
+    dst_heights[c] = tj3YUVPlaneHeight (c, height, dst_subsamp);
+    if (resample || src_subsamp == TJSAMP_GRAY)
+      size += (gsize) dst_strides[c] * dst_heights[c];
+  }
+  if (resample)
+    size += gst_turbojpeg_chroma_scratch_size (dst_strides[1]);
+
+  scratch = gst_turbojpeg_arena_acquire (thumb->arena, size);
+  rows = scratch;
+  for (c = 0; c < 3 && src_strides[c]; c++) {
+    src_planes[c] = rows;
+    rows += (gsize) src_strides[c] * src_heights[c];
+  }
+
+  if (tj3DecompressToYUVPlanes8 (thumb->tjInstanceDecode, map_info.data,
+          map_info.size, src_planes, src_strides) < 0) {
+    GST_WARNING_OBJECT (thumb, "TurboJPEG YUV decompression failed: %s",
+        tj3GetErrorStr (thumb->tjInstanceDecode));
+    goto drop;
+  }
+
+  dst_planes[0] = src_planes[0];
+  dst_strides[0] = src_strides[0];
+  for (c = 1; c < 3 && dst_strides[c]; c++) {
+    if (resample) {
+      dst_planes[c] = rows;
+      rows += (gsize) dst_strides[c] * dst_heights[c];
+    } else if (src_subsamp == TJSAMP_GRAY) {
+      /* Neutral chroma for a colour thumbnail of a grayscale source */
+      dst_planes[c] = rows;
+      memset (rows, 128, (gsize) dst_strides[c] * dst_heights[c]);
+      rows += (gsize) dst_strides[c] * dst_heights[c];
+    } else {
+      dst_planes[c] = src_planes[c];
+    }
+  }
+  for (c = 1; resample && c < 3; c++)
+    gst_turbojpeg_chroma_resample (&chroma, src_planes[c], src_strides[c],
+        src_strides[c], src_heights[c], dst_planes[c], dst_strides[c],
+        dst_strides[c], dst_heights[c], rows);
+
+  tj3Set (thumb->tjInstanceEncode, TJPARAM_QUALITY, quality);
+  tj3Set (thumb->tjInstanceEncode, TJPARAM_SUBSAMP, dst_subsamp);
+  if (tj3CompressFromYUVPlanes8 (thumb->tjInstanceEncode,
+          (const guchar **) dst_planes, width, dst_strides, height, &dst,
+          &dst_size) < 0) {
+    GST_WARNING_OBJECT (thumb, "Failed to compress JPEG from YUV: %s",
+        tj3GetErrorStr (thumb->tjInstanceEncode));
+    tj3Free (dst);
+    goto drop;
+  }
+
+  gst_turbojpeg_arena_release (thumb->arena, scratch);
+
+  GST_LOG_OBJECT (thumb, "%" G_GSIZE_FORMAT " byte JPEG scaled by %d/%d to "
+      "%dx%d, %" G_GSIZE_FORMAT " bytes", map_info.size, sf.num, sf.denom,
+      width, height, (gsize) dst_size);
+
+  *outbuf = gst_buffer_new_wrapped_full (0, dst, dst_size, 0, dst_size, dst,
+      (GDestroyNotify) tj3Free);
+  gst_buffer_copy_into (*outbuf, inbuf, GST_BUFFER_COPY_FLAGS |
+      GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+  gst_buffer_unmap (inbuf, &map_info);
+  gst_buffer_unref (inbuf);
+
+  return gst_turbojpeg_image_update_caps (trans, &thumb->out, width, height,
+      FALSE) ? GST_FLOW_OK : GST_FLOW_NOT_NEGOTIATED;
+
+drop:
+  /* One corrupt frame should not stop the stream */
+  if (scratch)
+    gst_turbojpeg_arena_release (thumb->arena, scratch);
+  gst_buffer_unmap (inbuf, &map_info);
+  gst_buffer_unref (inbuf);
+  return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
@@ -0,0 +1,73 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_THUMB_H__
+#define __GST_TURBOJPEG_THUMB_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <turbojpeg.h>
+
+#include "gstturbojpegarena.h"
+#include "gstturbojpegimage.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_TURBOJPEG_THUMB \
+  (gst_turbojpeg_thumb_get_type())
+#define GST_TURBOJPEG_THUMB(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_TURBOJPEG_THUMB,GstTurboJpegThumb))
+#define GST_TURBOJPEG_THUMB_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_TURBOJPEG_THUMB,GstTurboJpegThumbClass))
+#define GST_IS_TURBOJPEG_THUMB(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_TURBOJPEG_THUMB))
+#define GST_IS_TURBOJPEG_THUMB_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_TURBOJPEG_THUMB))
+
+typedef struct _GstTurboJpegThumb GstTurboJpegThumb;
+typedef struct _GstTurboJpegThumbClass GstTurboJpegThumbClass;
+
+struct _GstTurboJpegThumb
+{
+  GstBaseTransform parent;
+
+  tjhandle tjInstanceDecode;
+  tjhandle tjInstanceEncode;
+  GstTurboJpegArena *arena;   /* YUV planes reused across images */
+
+  /* Settings, protected by the object lock */
+  gint width;                 /* Box the thumbnail fits in, 0 = any */
+  gint height;
+  gint quality;
+  gint subsampling;           /* -1 keeps the subsampling of the source */
+
+  GstTurboJpegImageCaps out;  /* Geometry in the src caps */
+};
+
+struct _GstTurboJpegThumbClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_turbojpeg_thumb_get_type (void);
+gboolean gst_turbojpeg_thumb_register (GstPlugin * plugin);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_THUMB_H__ */
@@ -0,0 +1,348 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+#include "gstturbojpegtranscode.h"
+#include "gstturbojpegimage.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_turbojpeg_transcode_debug);
+#define GST_CAT_DEFAULT gst_turbojpeg_transcode_debug
+
+enum
+{
+  PROP_0,
+  PROP_QUALITY,
+  PROP_TARGET_SIZE,
+  PROP_SKIPPED
+};
+
+#define DEFAULT_QUALITY 75
+#define DEFAULT_TARGET_SIZE 0
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg")
+    );
+
+#define gst_turbojpeg_transcode_parent_class parent_class
+G_DEFINE_TYPE (GstTurboJpegTranscode, gst_turbojpeg_transcode,
+    GST_TYPE_BASE_TRANSFORM);
+
+gboolean
+gst_turbojpeg_transcode_register (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, "turbojpegtranscode", GST_RANK_NONE,
+      GST_TYPE_TURBOJPEG_TRANSCODE);
+}
+
+static void gst_turbojpeg_transcode_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_turbojpeg_transcode_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_turbojpeg_transcode_start (GstBaseTransform * trans);
+static gboolean gst_turbojpeg_transcode_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_turbojpeg_transcode_generate_output (GstBaseTransform
+    * trans, GstBuffer ** outbuf);
+
+static void
+gst_turbojpeg_transcode_class_init (GstTurboJpegTranscodeClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+  GstBaseTransformClass *trans_class;
+
+  gobject_class = (GObjectClass *) klass;
+  element_class = (GstElementClass *) klass;
+  trans_class = (GstBaseTransformClass *) klass;
+
+  gobject_class->set_property = gst_turbojpeg_transcode_set_property;
+  gobject_class->get_property = gst_turbojpeg_transcode_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_QUALITY,
+      g_param_spec_int ("quality", "Quality",
+          "JPEG quality the frames are re-encoded at (1-100)",
+          1, 100, DEFAULT_QUALITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TARGET_SIZE,
+      g_param_spec_uint ("target-size", "Target size",
+          "Frames of at most this many bytes are pushed without being "
+          "re-encoded (0 = re-encode every frame)",
+          0, G_MAXUINT, DEFAULT_TARGET_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SKIPPED,
+      g_param_spec_uint64 ("skipped", "Skipped",
+          "Frames pushed as they came, being small enough already or "
+          "growing when re-encoded",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "TurboJPEG Transcoder", "Codec/Encoder/Image",
+      "Re-encode JPEG images at another quality through their YUV planes",
+      "GStreamer TurboJPEG Plugin");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_turbojpeg_transcode_start);
+  trans_class->stop = GST_DEBUG_FUNCPTR (gst_turbojpeg_transcode_stop);
+  trans_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_turbojpeg_transcode_generate_output);
+
+  GST_DEBUG_CATEGORY_INIT (gst_turbojpeg_transcode_debug,
+      "turbojpegtranscode", 0, "TurboJPEG transcoder");
+}
+
+static void
+gst_turbojpeg_transcode_init (GstTurboJpegTranscode * transcode)
+{
+  transcode->tjInstanceDecode = NULL;
+  transcode->tjInstanceEncode = NULL;
+  transcode->arena = NULL;
+  transcode->quality = DEFAULT_QUALITY;
+  transcode->target_size = DEFAULT_TARGET_SIZE;
+}
+
+static void
+gst_turbojpeg_transcode_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstTurboJpegTranscode *transcode = GST_TURBOJPEG_TRANSCODE (object);
+
+  GST_OBJECT_LOCK (transcode);
+  switch (prop_id) {
+    case PROP_QUALITY:
+      transcode->quality = g_value_get_int (value);
+      break;
+    case PROP_TARGET_SIZE:
+      transcode->target_size = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (transcode);
+}
+
+static void
+gst_turbojpeg_transcode_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstTurboJpegTranscode *transcode = GST_TURBOJPEG_TRANSCODE (object);
+
+  GST_OBJECT_LOCK (transcode);
+  switch (prop_id) {
+    case PROP_QUALITY:
+      g_value_set_int (value, transcode->quality);
+      break;
+    case PROP_TARGET_SIZE:
+      g_value_set_uint (value, transcode->target_size);
+      break;
+    case PROP_SKIPPED:
+      g_value_set_uint64 (value, transcode->skipped);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (transcode);
+}
+
+static gboolean
+gst_turbojpeg_transcode_start (GstBaseTransform * trans)
+{
+  GstTurboJpegTranscode *transcode = GST_TURBOJPEG_TRANSCODE (trans);
+
+  transcode->tjInstanceDecode = tj3Init (TJINIT_DECOMPRESS);
+  transcode->tjInstanceEncode = tj3Init (TJINIT_COMPRESS);
+  if (!transcode->tjInstanceDecode || !transcode->tjInstanceEncode) {
+    GST_ERROR_OBJECT (transcode, "Failed to initialize TurboJPEG instances");
+    return FALSE;
+  }
+  transcode->arena = gst_turbojpeg_arena_new ();
+
+  GST_OBJECT_LOCK (transcode);
+  transcode->skipped = 0;
+  GST_OBJECT_UNLOCK (transcode);
+
+  return TRUE;
+}
+
+static gboolean
+gst_turbojpeg_transcode_stop (GstBaseTransform * trans)
+{
+  GstTurboJpegTranscode *transcode = GST_TURBOJPEG_TRANSCODE (trans);
+
+  if (transcode->tjInstanceDecode) {
+    tj3Destroy (transcode->tjInstanceDecode);
+    transcode->tjInstanceDecode = NULL;
+  }
+  if (transcode->tjInstanceEncode) {
+    tj3Destroy (transcode->tjInstanceEncode);
+    transcode->tjInstanceEncode = NULL;
+  }
+  if (transcode->arena) {
+    gst_turbojpeg_arena_free (transcode->arena);
+    transcode->arena = NULL;
+  }
+
+  return TRUE;
+}
+
+/* Push @inbuf as it came */
+static GstFlowReturn
+gst_turbojpeg_transcode_skip (GstTurboJpegTranscode * transcode,
+    GstBuffer * inbuf, GstMapInfo * map_info, GstBuffer ** outbuf)
+{
+  gst_buffer_unmap (inbuf, map_info);
+  *outbuf = inbuf;
+
+  GST_OBJECT_LOCK (transcode);
+  transcode->skipped++;
+  GST_OBJECT_UNLOCK (transcode);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_turbojpeg_transcode_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstTurboJpegTranscode *transcode = GST_TURBOJPEG_TRANSCODE (trans);
+  GstBuffer *inbuf = trans->queued_buf;
+  GstMapInfo map_info;
+  guint8 *scratch = NULL, *p;
+  guint8 *planes[3] = { NULL, NULL, NULL };
+  gint strides[3] = { 0, 0, 0 }, heights[3] = { 0, 0, 0 };
+  gint quality, subsamp, width, height, c, n_planes;
+  guint target_size;
+  gsize size = 0;
+  guchar *dst = NULL;
+  size_t dst_size = 0;
+
+  trans->queued_buf = NULL;
+  *outbuf = NULL;
+  if (!inbuf)
+    return GST_FLOW_OK;
+
+  GST_OBJECT_LOCK (transcode);
+  quality = transcode->quality;
+  target_size = transcode->target_size;
+  GST_OBJECT_UNLOCK (transcode);
+
+  if (!gst_buffer_map (inbuf, &map_info, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (transcode, "Failed to map input buffer");
+    gst_buffer_unref (inbuf);
+    return GST_FLOW_ERROR;
+  }
+
+  if (target_size && map_info.size <= target_size) {
+    GST_LOG_OBJECT (transcode, "%" G_GSIZE_FORMAT " byte frame within the "
+        "target size", map_info.size);
+    return gst_turbojpeg_transcode_skip (transcode, inbuf, &map_info, outbuf);
+  }
+
+  subsamp = gst_turbojpeg_image_read_yuv_header (transcode->tjInstanceDecode,
+      map_info.data, map_info.size);
+  if (subsamp == TJSAMP_UNKNOWN) {
+    GST_WARNING_OBJECT (transcode, "Invalid JPEG or not decodable to 8-bit "
+        "YUV");
+    goto drop;
+  }
+
+  width = tj3Get (transcode->tjInstanceDecode, TJPARAM_JPEGWIDTH);
+  height = tj3Get (transcode->tjInstanceDecode, TJPARAM_JPEGHEIGHT);
+
+  /* The planes keep the source layout, so the encoder takes them as they
+   * are decoded and the chroma is never resampled */
+  n_planes = subsamp == TJSAMP_GRAY ? 1 : 3;
+  for (c = 0; c < n_planes; c++) {
+    strides[c] = tj3YUVPlaneWidth (c, width, subsamp);
+    heights[c] = tj3YUVPlaneHeight (c, height, subsamp);
+    size += (gsize) strides[c] * heights[c];
+  }
+
+  scratch = gst_turbojpeg_arena_acquire (transcode->arena, size);
+  p = scratch;
+  for (c = 0; c < n_planes; c++) {
+    planes[c] = p;
+    p += (gsize) strides[c] * heights[c];
+  }
+
+  if (tj3DecompressToYUVPlanes8 (transcode->tjInstanceDecode, map_info.data,
+          map_info.size, planes, strides) < 0) {
+    GST_WARNING_OBJECT (transcode, "TurboJPEG YUV decompression failed: %s",
+        tj3GetErrorStr (transcode->tjInstanceDecode));
+    goto drop;
+  }
+
+  tj3Set (transcode->tjInstanceEncode, TJPARAM_QUALITY, quality);
+  tj3Set (transcode->tjInstanceEncode, TJPARAM_SUBSAMP, subsamp);
+  if (tj3CompressFromYUVPlanes8 (transcode->tjInstanceEncode,
+          (const guchar **) planes, width, strides, height, &dst,
+          &dst_size) < 0) {
+    GST_WARNING_OBJECT (transcode, "Failed to compress JPEG from YUV: %s",
+        tj3GetErrorStr (transcode->tjInstanceEncode));
+    tj3Free (dst);
+    goto drop;
+  }
+
+  gst_turbojpeg_arena_release (transcode->arena, scratch);
+
+  /* A frame already coarser than the target quality only grows */
+  if (dst_size >= map_info.size) {
+    GST_LOG_OBJECT (transcode, "Re-encoding grew the frame from %"
+        G_GSIZE_FORMAT " to %" G_GSIZE_FORMAT " bytes", map_info.size,
+        (gsize) dst_size);
+    tj3Free (dst);
+    return gst_turbojpeg_transcode_skip (transcode, inbuf, &map_info, outbuf);
+  }
+
+  *outbuf = gst_buffer_new_wrapped_full (0, dst, dst_size, 0, dst_size, dst,
+      (GDestroyNotify) tj3Free);
+  gst_buffer_copy_into (*outbuf, inbuf, GST_BUFFER_COPY_METADATA, 0, -1);
+
+  gst_buffer_unmap (inbuf, &map_info);
+  gst_buffer_unref (inbuf);
+
+  return GST_FLOW_OK;
+
+drop:
+  /* One corrupt frame should not stop the stream */
+  if (scratch)
+    gst_turbojpeg_arena_release (transcode->arena, scratch);
+  gst_buffer_unmap (inbuf, &map_info);
+  gst_buffer_unref (inbuf);
+  return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
@@ -0,0 +1,69 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_TRANSCODE_H__
+#define __GST_TURBOJPEG_TRANSCODE_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <turbojpeg.h>
+
+#include "gstturbojpegarena.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_TURBOJPEG_TRANSCODE \
+  (gst_turbojpeg_transcode_get_type())
+#define GST_TURBOJPEG_TRANSCODE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_TURBOJPEG_TRANSCODE,GstTurboJpegTranscode))
+#define GST_TURBOJPEG_TRANSCODE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_TURBOJPEG_TRANSCODE,GstTurboJpegTranscodeClass))
+#define GST_IS_TURBOJPEG_TRANSCODE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_TURBOJPEG_TRANSCODE))
+#define GST_IS_TURBOJPEG_TRANSCODE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_TURBOJPEG_TRANSCODE))
+
+typedef struct _GstTurboJpegTranscode GstTurboJpegTranscode;
+typedef struct _GstTurboJpegTranscodeClass GstTurboJpegTranscodeClass;
+
+struct _GstTurboJpegTranscode
+{
+  GstBaseTransform parent;
+
+  tjhandle tjInstanceDecode;
+  tjhandle tjInstanceEncode;
+  GstTurboJpegArena *arena;   /* YUV planes reused across frames */
+
+  /* Settings and statistics, protected by the object lock */
+  gint quality;
+  guint target_size;          /* Frames this small pass as is, 0 = none */
+  guint64 skipped;            /* Frames pushed without re-encoding */
+};
+
+struct _GstTurboJpegTranscodeClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_turbojpeg_transcode_get_type (void);
+gboolean gst_turbojpeg_transcode_register (GstPlugin * plugin);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_TRANSCODE_H__ */
@@ -0,0 +1,479 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <string.h>
+
+#include "gstturbojpegtransform.h"
+#include "gstturbojpegscan.h"
+#include "gstturbojpegimage.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_turbojpeg_transform_debug);
+#define GST_CAT_DEFAULT gst_turbojpeg_transform_debug
+
+enum
+{
+  PROP_0,
+  PROP_METHOD,
+  PROP_CROP_X,
+  PROP_CROP_Y,
+  PROP_CROP_WIDTH,
+  PROP_CROP_HEIGHT,
+  PROP_GRAYSCALE,
+  PROP_TRIM
+};
+
+#define DEFAULT_METHOD GST_TURBOJPEG_TRANSFORM_NONE
+#define DEFAULT_GRAYSCALE FALSE
+#define DEFAULT_TRIM TRUE
+
+/* Operation that displays an image of each EXIF orientation upright */
+static const gint exif_orientation_ops[9] = {
+  TJXOP_NONE, TJXOP_NONE, TJXOP_HFLIP, TJXOP_ROT180, TJXOP_VFLIP,
+  TJXOP_TRANSPOSE, TJXOP_ROT90, TJXOP_TRANSVERSE, TJXOP_ROT270
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg")
+    );
+
+#define GST_TYPE_TURBOJPEG_TRANSFORM_METHOD \
+  (gst_turbojpeg_transform_method_get_type ())
+static GType
+gst_turbojpeg_transform_method_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue methods[] = {
+    {GST_TURBOJPEG_TRANSFORM_NONE, "No transform", "none"},
+    {GST_TURBOJPEG_TRANSFORM_HORIZONTAL_FLIP, "Flip horizontally",
+        "horizontal-flip"},
+    {GST_TURBOJPEG_TRANSFORM_VERTICAL_FLIP, "Flip vertically",
+        "vertical-flip"},
+    {GST_TURBOJPEG_TRANSFORM_TRANSPOSE,
+        "Flip across the upper left/lower right diagonal", "transpose"},
+    {GST_TURBOJPEG_TRANSFORM_TRANSVERSE,
+        "Flip across the upper right/lower left diagonal", "transverse"},
+    {GST_TURBOJPEG_TRANSFORM_ROTATE_90, "Rotate 90 degrees clockwise",
+        "rotate-90"},
+    {GST_TURBOJPEG_TRANSFORM_ROTATE_180, "Rotate 180 degrees", "rotate-180"},
+    {GST_TURBOJPEG_TRANSFORM_ROTATE_270, "Rotate 90 degrees counterclockwise",
+        "rotate-270"},
+    {GST_TURBOJPEG_TRANSFORM_AUTO,
+        "Undo the EXIF orientation of every image and reset it", "auto"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = g_enum_register_static ("GstTurboJpegTransformMethod",
+        methods);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+#define gst_turbojpeg_transform_parent_class parent_class
+G_DEFINE_TYPE (GstTurboJpegTransform, gst_turbojpeg_transform,
+    GST_TYPE_BASE_TRANSFORM);
+
+gboolean
+gst_turbojpeg_transform_register (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, "turbojpegtransform", GST_RANK_NONE,
+      GST_TYPE_TURBOJPEG_TRANSFORM);
+}
+
+static void gst_turbojpeg_transform_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_turbojpeg_transform_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_turbojpeg_transform_start (GstBaseTransform * trans);
+static gboolean gst_turbojpeg_transform_stop (GstBaseTransform * trans);
+static gboolean gst_turbojpeg_transform_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
+static GstFlowReturn gst_turbojpeg_transform_generate_output (GstBaseTransform
+    * trans, GstBuffer ** outbuf);
+
+static void
+gst_turbojpeg_transform_class_init (GstTurboJpegTransformClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+  GstBaseTransformClass *trans_class;
+
+  gobject_class = (GObjectClass *) klass;
+  element_class = (GstElementClass *) klass;
+  trans_class = (GstBaseTransformClass *) klass;
+
+  gobject_class->set_property = gst_turbojpeg_transform_set_property;
+  gobject_class->get_property = gst_turbojpeg_transform_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_METHOD,
+      g_param_spec_enum ("method", "Method",
+          "Lossless rotation or flip applied to the DCT coefficients",
+          GST_TYPE_TURBOJPEG_TRANSFORM_METHOD, DEFAULT_METHOD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_X,
+      g_param_spec_int ("crop-x", "Crop X",
+          "Left edge of the area to keep, in transformed image pixels. "
+          "Moved left to the iMCU grid as the crop is lossless",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_Y,
+      g_param_spec_int ("crop-y", "Crop Y",
+          "Top edge of the area to keep, in transformed image pixels. "
+          "Moved up to the iMCU grid as the crop is lossless",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_WIDTH,
+      g_param_spec_int ("crop-width", "Crop width",
+          "Width of the area to keep (0 = up to the right edge)",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_HEIGHT,
+      g_param_spec_int ("crop-height", "Crop height",
+          "Height of the area to keep (0 = down to the bottom edge)",
+          0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_GRAYSCALE,
+      g_param_spec_boolean ("grayscale", "Grayscale",
+          "Drop the chroma components, keeping the luma untouched",
+          DEFAULT_GRAYSCALE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TRIM,
+      g_param_spec_boolean ("trim", "Trim",
+          "Drop partial iMCUs on the edges a rotation or flip moves, which "
+          "could not be transformed; otherwise they are left as they are",
+          DEFAULT_TRIM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "TurboJPEG Transform", "Filter/Effect/Image",
+      "Losslessly rotate, flip, crop or desaturate JPEG images without "
+      "decoding them", "GStreamer TurboJPEG Plugin");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_turbojpeg_transform_start);
+  trans_class->stop = GST_DEBUG_FUNCPTR (gst_turbojpeg_transform_stop);
+  trans_class->transform_caps =
+      GST_DEBUG_FUNCPTR (gst_turbojpeg_image_transform_caps);
+  trans_class->set_caps = GST_DEBUG_FUNCPTR (gst_turbojpeg_transform_set_caps);
+  trans_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_turbojpeg_transform_generate_output);
+
+  GST_DEBUG_CATEGORY_INIT (gst_turbojpeg_transform_debug,
+      "turbojpegtransform", 0, "TurboJPEG lossless transform");
+}
+
+static void
+gst_turbojpeg_transform_init (GstTurboJpegTransform * self)
+{
+  self->tjInstance = NULL;
+  self->method = DEFAULT_METHOD;
+  self->grayscale = DEFAULT_GRAYSCALE;
+  self->trim = DEFAULT_TRIM;
+}
+
+static void
+gst_turbojpeg_transform_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstTurboJpegTransform *self = GST_TURBOJPEG_TRANSFORM (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_METHOD:
+      self->method = g_value_get_enum (value);
+      break;
+    case PROP_CROP_X:
+      self->crop_x = g_value_get_int (value);
+      break;
+    case PROP_CROP_Y:
+      self->crop_y = g_value_get_int (value);
+      break;
+    case PROP_CROP_WIDTH:
+      self->crop_width = g_value_get_int (value);
+      break;
+    case PROP_CROP_HEIGHT:
+      self->crop_height = g_value_get_int (value);
+      break;
+    case PROP_GRAYSCALE:
+      self->grayscale = g_value_get_boolean (value);
+      break;
+    case PROP_TRIM:
+      self->trim = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_turbojpeg_transform_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstTurboJpegTransform *self = GST_TURBOJPEG_TRANSFORM (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_METHOD:
+      g_value_set_enum (value, self->method);
+      break;
+    case PROP_CROP_X:
+      g_value_set_int (value, self->crop_x);
+      break;
+    case PROP_CROP_Y:
+      g_value_set_int (value, self->crop_y);
+      break;
+    case PROP_CROP_WIDTH:
+      g_value_set_int (value, self->crop_width);
+      break;
+    case PROP_CROP_HEIGHT:
+      g_value_set_int (value, self->crop_height);
+      break;
+    case PROP_GRAYSCALE:
+      g_value_set_boolean (value, self->grayscale);
+      break;
+    case PROP_TRIM:
+      g_value_set_boolean (value, self->trim);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static gboolean
+gst_turbojpeg_transform_start (GstBaseTransform * trans)
+{
+  GstTurboJpegTransform *self = GST_TURBOJPEG_TRANSFORM (trans);
+
+  self->tjInstance = tj3Init (TJINIT_TRANSFORM);
+  if (!self->tjInstance) {
+    GST_ERROR_OBJECT (self, "Failed to initialize TurboJPEG transform "
+        "instance");
+    return FALSE;
+  }
+  gst_turbojpeg_image_caps_reset (&self->out);
+
+  return TRUE;
+}
+
+static gboolean
+gst_turbojpeg_transform_stop (GstBaseTransform * trans)
+{
+  GstTurboJpegTransform *self = GST_TURBOJPEG_TRANSFORM (trans);
+
+  if (self->tjInstance) {
+    tj3Destroy (self->tjInstance);
+    self->tjInstance = NULL;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_turbojpeg_transform_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstTurboJpegTransform *self = GST_TURBOJPEG_TRANSFORM (trans);
+
+  gst_turbojpeg_image_caps_reset (&self->out);
+  return TRUE;
+}
+
+/* Whether @op swaps the rows and columns of the image */
+static gboolean
+gst_turbojpeg_transform_is_transposed (gint op)
+{
+  return op == TJXOP_TRANSPOSE || op == TJXOP_TRANSVERSE ||
+      op == TJXOP_ROT90 || op == TJXOP_ROT270;
+}
+
+/* Size of the transformed image and its iMCU, before any crop */
+static void
+gst_turbojpeg_transform_get_size (const GstTurboJpegScanInfo * info,
+    gint op, gboolean grayscale, gboolean trim, gint * width, gint * height,
+    gint * mcu_w, gint * mcu_h)
+{
+  gboolean transposed = gst_turbojpeg_transform_is_transposed (op);
+
+  /* A single output component is processed in 8x8 blocks */
+  *mcu_w = *mcu_h = 8;
+  if (info->n_components > 1 && !grayscale) {
+    *mcu_w = 8 * (transposed ? info->max_v_samp : info->max_h_samp);
+    *mcu_h = 8 * (transposed ? info->max_h_samp : info->max_v_samp);
+  }
+  *width = transposed ? info->height : info->width;
+  *height = transposed ? info->width : info->height;
+
+  /* Edges that end up moved lose their partial iMCUs */
+  if (trim && (op == TJXOP_HFLIP || op == TJXOP_TRANSVERSE ||
+          op == TJXOP_ROT90 || op == TJXOP_ROT180))
+    *width -= *width % *mcu_w;
+  if (trim && (op == TJXOP_VFLIP || op == TJXOP_TRANSVERSE ||
+          op == TJXOP_ROT180 || op == TJXOP_ROT270))
+    *height -= *height % *mcu_h;
+}
+
+static GstFlowReturn
+gst_turbojpeg_transform_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstTurboJpegTransform *self = GST_TURBOJPEG_TRANSFORM (trans);
+  GstBuffer *inbuf = trans->queued_buf;
+  GstTurboJpegTransformMethod method;
+  GstTurboJpegScanInfo info;
+  GstMapInfo map_info;
+  tjregion crop;
+  tjtransform xform;
+  guchar *dst = NULL;
+  size_t dst_size = 0;
+  gsize exif_offset;
+  gboolean exif_be, grayscale, trim;
+  gint orientation = 0;
+  gint width, height, mcu_w, mcu_h;
+
+  trans->queued_buf = NULL;
+  *outbuf = NULL;
+  if (!inbuf)
+    return GST_FLOW_OK;
+
+  GST_OBJECT_LOCK (self);
+  method = self->method;
+  crop.x = self->crop_x;
+  crop.y = self->crop_y;
+  crop.w = self->crop_width;
+  crop.h = self->crop_height;
+  grayscale = self->grayscale;
+  trim = self->trim;
+  GST_OBJECT_UNLOCK (self);
+
+  if (!gst_buffer_map (inbuf, &map_info, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (self, "Failed to map input buffer");
+    gst_buffer_unref (inbuf);
+    return GST_FLOW_ERROR;
+  }
+
+  if (!gst_turbojpeg_scan_headers (map_info.data, map_info.size, &info)) {
+    GST_WARNING_OBJECT (self, "Invalid JPEG headers");
+    goto drop;
+  }
+
+  memset (&xform, 0, sizeof (xform));
+  if (method == GST_TURBOJPEG_TRANSFORM_AUTO) {
+    orientation = gst_turbojpeg_exif_orientation (map_info.data,
+        map_info.size, &exif_offset, &exif_be);
+    xform.op = exif_orientation_ops[orientation];
+  } else {
+    xform.op = method;
+  }
+  if (trim)
+    xform.options |= TJXOPT_TRIM;
+  if (grayscale)
+    xform.options |= TJXOPT_GRAY;
+
+  gst_turbojpeg_transform_get_size (&info, xform.op, grayscale, trim,
+      &width, &height, &mcu_w, &mcu_h);
+
+  /* The crop has to start on the iMCU grid, so it grows to the top left to
+   * still cover the requested area */
+  if (crop.x || crop.y || crop.w || crop.h) {
+    if (crop.x >= width || crop.y >= height) {
+      GST_WARNING_OBJECT (self, "Crop origin %d,%d outside of the %dx%d "
+          "image, keeping all of it", crop.x, crop.y, width, height);
+    } else {
+      xform.r.x = crop.x / mcu_w * mcu_w;
+      xform.r.y = crop.y / mcu_h * mcu_h;
+      xform.r.w = (crop.w ? MIN (crop.x + crop.w, width) : width) - xform.r.x;
+      xform.r.h = (crop.h ? MIN (crop.y + crop.h, height) : height) -
+          xform.r.y;
+      xform.options |= TJXOPT_CROP;
+      width = xform.r.w;
+      height = xform.r.h;
+    }
+  }
+
+  /* Nothing to do, hand the image on untouched */
+  if (xform.op == TJXOP_NONE && !(xform.options & (TJXOPT_CROP |
+              TJXOPT_GRAY))) {
+    gst_buffer_unmap (inbuf, &map_info);
+    *outbuf = inbuf;
+    return gst_turbojpeg_image_update_caps (trans, &self->out, width,
+        height, FALSE) ? GST_FLOW_OK : GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (tj3Transform (self->tjInstance, map_info.data, map_info.size, 1, &dst,
+          &dst_size, &xform) < 0) {
+    GST_WARNING_OBJECT (self, "Failed to transform JPEG: %s",
+        tj3GetErrorStr (self->tjInstance));
+    tj3Free (dst);
+    goto drop;
+  }
+
+  /* The copied EXIF segment would have viewers rotate the image again */
+  if (orientation > 1 && gst_turbojpeg_exif_orientation (dst, dst_size,
+          &exif_offset, &exif_be)) {
+    dst[exif_offset] = exif_be ? 0 : 1;
+    dst[exif_offset + 1] = exif_be ? 1 : 0;
+  }
+
+  *outbuf = gst_buffer_new_wrapped_full (0, dst, dst_size, 0, dst_size, dst,
+      (GDestroyNotify) tj3Free);
+  /* Metas describing the picture would no longer match its geometry */
+  gst_buffer_copy_into (*outbuf, inbuf, GST_BUFFER_COPY_FLAGS |
+      GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+  gst_buffer_unmap (inbuf, &map_info);
+  gst_buffer_unref (inbuf);
+
+  return gst_turbojpeg_image_update_caps (trans, &self->out, width, height,
+      gst_turbojpeg_transform_is_transposed (xform.op)) ? GST_FLOW_OK :
+      GST_FLOW_NOT_NEGOTIATED;
+
+drop:
+  /* One corrupt frame should not stop the stream */
+  gst_buffer_unmap (inbuf, &map_info);
+  gst_buffer_unref (inbuf);
+  return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
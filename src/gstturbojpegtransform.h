@@ -0,0 +1,87 @@
+/* GStreamer TurboJPEG Plugin
+ * Copyright (C) 2024 <organization>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_TURBOJPEG_TRANSFORM_H__
+#define __GST_TURBOJPEG_TRANSFORM_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <turbojpeg.h>
+
+#include "gstturbojpegimage.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_TURBOJPEG_TRANSFORM \
+  (gst_turbojpeg_transform_get_type())
+#define GST_TURBOJPEG_TRANSFORM(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_TURBOJPEG_TRANSFORM,GstTurboJpegTransform))
+#define GST_TURBOJPEG_TRANSFORM_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_TURBOJPEG_TRANSFORM,GstTurboJpegTransformClass))
+#define GST_IS_TURBOJPEG_TRANSFORM(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_TURBOJPEG_TRANSFORM))
+#define GST_IS_TURBOJPEG_TRANSFORM_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_TURBOJPEG_TRANSFORM))
+
+typedef struct _GstTurboJpegTransform GstTurboJpegTransform;
+typedef struct _GstTurboJpegTransformClass GstTurboJpegTransformClass;
+
+/* Lossless operations, in the order of TurboJPEG's TJXOP values */
+typedef enum
+{
+  GST_TURBOJPEG_TRANSFORM_NONE,
+  GST_TURBOJPEG_TRANSFORM_HORIZONTAL_FLIP,
+  GST_TURBOJPEG_TRANSFORM_VERTICAL_FLIP,
+  GST_TURBOJPEG_TRANSFORM_TRANSPOSE,
+  GST_TURBOJPEG_TRANSFORM_TRANSVERSE,
+  GST_TURBOJPEG_TRANSFORM_ROTATE_90,
+  GST_TURBOJPEG_TRANSFORM_ROTATE_180,
+  GST_TURBOJPEG_TRANSFORM_ROTATE_270,
+  GST_TURBOJPEG_TRANSFORM_AUTO         /* From the EXIF orientation */
+} GstTurboJpegTransformMethod;
+
+struct _GstTurboJpegTransform
+{
+  GstBaseTransform parent;
+
+  tjhandle tjInstance;
+
+  /* Settings, protected by the object lock */
+  GstTurboJpegTransformMethod method;
+  gint crop_x;                /* In transformed image pixels */
+  gint crop_y;
+  gint crop_width;            /* 0 keeps everything right of crop_x */
+  gint crop_height;
+  gboolean grayscale;
+  gboolean trim;
+
+  GstTurboJpegImageCaps out;  /* Geometry in the src caps */
+};
+
+struct _GstTurboJpegTransformClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_turbojpeg_transform_get_type (void);
+gboolean gst_turbojpeg_transform_register (GstPlugin * plugin);
+
+G_END_DECLS
+
+#endif /* __GST_TURBOJPEG_TRANSFORM_H__ */
@@ -6,6 +6,10 @@
 
 #include "gstturbojpegdec.h"
 #include "gstturbojpegenc.h"
+#include "gstturbojpegblockmap.h"
+#include "gstturbojpegtransform.h"
+#include "gstturbojpegthumb.h"
+#include "gstturbojpegtranscode.h"
 
 static gboolean
 plugin_init (GstPlugin * plugin)
@@ -14,6 +18,10 @@ plugin_init (GstPlugin * plugin)
 
   ret |= gst_turbojpegdec_register (plugin);
   ret |= gst_turbojpegenc_register (plugin);
+  ret |= gst_turbojpeg_block_map_register (plugin);
+  ret |= gst_turbojpeg_transform_register (plugin);
+  ret |= gst_turbojpeg_thumb_register (plugin);
+  ret |= gst_turbojpeg_transcode_register (plugin);
 
   return ret;
 }
@@ -13,7 +13,12 @@ YELLOW='\033[1;33m'
 BLUE='\033[0;34m'
 NC='\033[0m' # No Color
 
-# Test configuration
+# Test configuration. The odd size is not a multiple of the iMCU, which
+# exercises the padded decode and chroma edge paths
+declare -a TEST_SIZES=(
+    "640x480"
+    "642x482"
+)
 TEST_WIDTH=640
 TEST_HEIGHT=480
 TEST_PATTERN="smpte"
@@ -30,7 +35,7 @@ mkdir -p "$OUTPUT_DIR"
 echo -e "${BLUE}=== TurboJPEG YUV Decoder Combination Test ===${NC}"
 echo "Testing all JPEG subsampling inputs vs GStreamer YUV output formats"
 echo "Output directory: $OUTPUT_DIR"
-echo "Test resolution: ${TEST_WIDTH}x${TEST_HEIGHT}"
+echo "Test resolutions: ${TEST_SIZES[*]}"
 echo ""
 
 # Define test combinations
@@ -47,6 +52,10 @@ declare -a OUTPUT_FORMATS=(
     "YV12" 
     "Y42B"
     "Y444"
+    "NV12"
+    "NV21"
+    "YUY2"
+    "UYVY"
 )
 
 # RGB formats for comparison
@@ -66,11 +75,11 @@ run_test() {
     local expected_subsamp="$2"
     local input_desc="$3"
     local output_format="$4"
-    local test_name="${input_format}_to_${output_format}"
+    local test_name="${input_format}_to_${output_format}_${TEST_WIDTH}x${TEST_HEIGHT}"
     
     TOTAL_TESTS=$((TOTAL_TESTS + 1))
     
-    echo -n "Testing ${input_format} → ${output_format} (${input_desc}): "
+    echo -n "Testing ${input_format} → ${output_format} ${TEST_WIDTH}x${TEST_HEIGHT} (${input_desc}): "
     
     # Create test pipeline
     local pipeline="videotestsrc pattern=${TEST_PATTERN} num-buffers=1 ! \
@@ -85,7 +94,7 @@ run_test() {
     
     # Run test with debug output
     local debug_output
-    if debug_output=$(GST_DEBUG=*turbojpeg*:4 gst-launch-1.0 $pipeline 2>&1); then
+    if debug_output=$(GST_DEBUG=turbojpegdec:5 gst-launch-1.0 $pipeline 2>&1); then
         # Check if conversion was detected when expected
         local needs_conversion=false
         
@@ -95,13 +104,17 @@ run_test() {
                 needs_conversion=false ;;
             "I420_YV12"|"YV12_I420")
                 needs_conversion=false ;; # Same subsampling, just plane swap
+            "I420_NV12"|"I420_NV21")
+                needs_conversion=false ;; # Same subsampling, interleaved chroma
+            "Y42B_YUY2"|"Y42B_UYVY")
+                needs_conversion=false ;; # Same subsampling, packed
             *)
                 needs_conversion=true ;;
         esac
         
         # Check debug output for expected behavior
-        local subsamp_found=$(echo "$debug_output" | grep "SUBSAMPLING DEBUG (mode=${expected_subsamp})" | wc -l)
-        local conversion_found=$(echo "$debug_output" | grep "Subsampling format conversion" | wc -l)
+        local subsamp_found=$(echo "$debug_output" | grep "subsampling: ${expected_subsamp}," | wc -l)
+        local conversion_found=$(echo "$debug_output" | grep "Resampling chroma from" | wc -l)
         
         if [[ $subsamp_found -gt 0 ]]; then
             if [[ $needs_conversion == true && $conversion_found -gt 0 ]]; then
@@ -169,7 +182,7 @@ test_camera_simulation() {
             pngenc ! \
             filesink location=${OUTPUT_DIR}/camera_sim_output.png"
         
-        if GST_DEBUG=*turbojpeg*:4 gst-launch-1.0 $pipeline 2>&1 | grep -q "Subsampling format conversion"; then
+        if GST_DEBUG=turbojpegdec:5 gst-launch-1.0 $pipeline 2>&1 | grep -q "Resampling chroma from"; then
             echo -e "${GREEN}PASS${NC} (conversion applied)"
         else
             echo -e "${RED}FAIL${NC} (no conversion detected)"
@@ -181,6 +194,312 @@ test_camera_simulation() {
     fi
 }
 
+# Function to run a smoke pipeline through one of the JPEG-to-JPEG
+# elements, optionally checking a caps fragment it negotiates
+run_element_test() {
+    local name="$1"
+    local element="$2"
+    local expected_caps="$3"
+
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+
+    echo -n "Testing ${name}: "
+
+    local pipeline="videotestsrc pattern=${TEST_PATTERN} num-buffers=3 ! \
+        video/x-raw,width=642,height=482,format=I420 ! \
+        jpegenc ! \
+        ${element} ! \
+        turbojpegdec ! \
+        fakesink"
+
+    local output
+    if output=$(gst-launch-1.0 -v $pipeline 2>&1); then
+        if [[ -z "$expected_caps" ]] || echo "$output" | grep -q "$expected_caps"; then
+            echo -e "${GREEN}PASS${NC}"
+            PASSED_TESTS=$((PASSED_TESTS + 1))
+        else
+            echo -e "${RED}FAIL${NC} (no ${expected_caps} in the caps)"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+        fi
+    else
+        echo -e "${RED}FAIL${NC} (pipeline error)"
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+        echo "Error: $output" | head -3
+    fi
+}
+
+# Smoke tests of the elements working on JPEG data, on a 642x482 4:2:0
+# image that is not a whole number of 16x16 iMCUs
+test_jpeg_elements() {
+    echo -e "\n${BLUE}=== JPEG Element Tests ===${NC}"
+
+    run_element_test "turbojpegblockmap" \
+        "turbojpegblockmap ac-energy=true"
+    # A quarter turn trims the partial iMCU column moved to the right edge
+    run_element_test "turbojpegtransform rotate-90" \
+        "turbojpegtransform method=rotate-90" "width=(int)480, height=(int)642"
+    run_element_test "turbojpegtransform crop" \
+        "turbojpegtransform crop-x=20 crop-y=20 crop-width=300 crop-height=200" \
+        "width=(int)304, height=(int)204"
+    run_element_test "turbojpegtransform auto" \
+        "turbojpegtransform method=auto" "width=(int)642, height=(int)482"
+    # 1/4 scale rounds 642x482 up to 161x121
+    run_element_test "turbojpegthumb" \
+        "turbojpegthumb width=161 height=121 quality=80" \
+        "width=(int)161, height=(int)121"
+    run_element_test "turbojpegtranscode" \
+        "turbojpegtranscode quality=30"
+}
+
+# Function to check the size turbojpegdec scale=0/1 picks for a 4K JPEG
+# in front of the given downstream elements
+run_scale_test() {
+    local name="$1"
+    local downstream="$2"
+    local expected_caps="$3"
+
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+
+    echo -n "Testing ${name}: "
+
+    local pipeline="videotestsrc pattern=${TEST_PATTERN} num-buffers=2 ! \
+        video/x-raw,width=3840,height=2160,format=I420 ! \
+        jpegenc ! \
+        turbojpegdec scale=0/1 ! \
+        ${downstream} ! \
+        fakesink"
+
+    local output
+    if output=$(gst-launch-1.0 -v $pipeline 2>&1); then
+        if echo "$output" | grep "turbojpegdec0.GstPad:src: caps" | grep -q "$expected_caps"; then
+            echo -e "${GREEN}PASS${NC}"
+            PASSED_TESTS=$((PASSED_TESTS + 1))
+        else
+            echo -e "${RED}FAIL${NC} (decoder did not output ${expected_caps})"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+        fi
+    else
+        echo -e "${RED}FAIL${NC} (pipeline error)"
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+        echo "Error: $output" | head -3
+    fi
+}
+
+# Automatic DCT scaling: a fixed downstream size is met by the IDCT, while
+# a videoscale, which takes any size, keeps the decoder at full resolution
+# instead of upscaling a 1/8 decode
+test_auto_scale() {
+    echo -e "\n${BLUE}=== Automatic Scale Tests ===${NC}"
+
+    run_scale_test "scale=0/1 to fixed 960x540" \
+        "video/x-raw,width=960,height=540" \
+        "width=(int)960, height=(int)540"
+    run_scale_test "scale=0/1 behind videoscale to 854x480" \
+        "videoscale ! video/x-raw,width=854,height=480" \
+        "width=(int)3840, height=(int)2160"
+}
+
+# PSNR in dB between two raw files of 8-bit or 16-bit little endian
+# samples, 99 when they are identical
+psnr() {
+    python3 - "$1" "$2" "$3" <<'PYEOF'
+import array, math, sys
+a = open(sys.argv[1], 'rb').read()
+b = open(sys.argv[2], 'rb').read()
+depth = int(sys.argv[3])
+if len(a) != len(b) or not a:
+    print(0)
+    sys.exit()
+if depth > 8:
+    a, b = array.array('H', a), array.array('H', b)
+mse = sum((x - y) ** 2 for x, y in zip(a, b)) / len(a)
+peak = (1 << depth) - 1
+print(99 if mse == 0 else round(10 * math.log10(peak * peak / mse), 2))
+PYEOF
+}
+
+# Function to compare the raw output of a decode pipeline with that of a
+# reference pipeline, bit-exactly or against a minimum PSNR in dB
+run_compare_test() {
+    local name="$1"
+    local pipeline="$2"
+    local reference="$3"
+    local min_psnr="$4"
+    local depth="${5:-8}"
+    local out_file="${OUTPUT_DIR}/compare_out.raw"
+    local ref_file="${OUTPUT_DIR}/compare_ref.raw"
+
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+
+    echo -n "Testing ${name}: "
+
+    rm -f "$out_file" "$ref_file"
+    if ! gst-launch-1.0 -q $pipeline ! \
+            filesink location="$out_file" >/dev/null 2>&1 ||
+        ! gst-launch-1.0 -q $reference ! \
+            filesink location="$ref_file" >/dev/null 2>&1; then
+        echo -e "${RED}FAIL${NC} (pipeline error)"
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+        return
+    fi
+
+    if [[ "$min_psnr" == "exact" ]]; then
+        if cmp -s "$out_file" "$ref_file"; then
+            echo -e "${GREEN}PASS${NC}"
+            PASSED_TESTS=$((PASSED_TESTS + 1))
+        else
+            echo -e "${RED}FAIL${NC} (output differs)"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+        fi
+        return
+    fi
+
+    local value
+    value=$(psnr "$out_file" "$ref_file" "$depth")
+    if awk -v a="$value" -v b="$min_psnr" 'BEGIN { exit !(a >= b) }'; then
+        echo -e "${GREEN}PASS${NC} (${value} dB)"
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}FAIL${NC} (${value} dB, expected ${min_psnr} dB)"
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+}
+
+# Restart-marker slices: decoding with slice threads has to give exactly
+# what a whole-frame decode gives, at every band seam
+test_slices() {
+    echo -e "\n${BLUE}=== Slice Decode Tests ===${NC}"
+
+    if ! command -v jpegtran >/dev/null; then
+        echo -e "${YELLOW}jpegtran not found, skipping${NC}"
+        return
+    fi
+
+    for input_combo in "${INPUT_FORMATS[@]}"; do
+        IFS=':' read -r input_format expected_subsamp input_desc <<< "$input_combo"
+        local base="${OUTPUT_DIR}/slices_${input_format}"
+        local source="filesrc location=${base}_dri.jpg ! jpegparse"
+
+        # One restart interval per MCU row
+        if ! gst-launch-1.0 -q videotestsrc pattern=${TEST_PATTERN} num-buffers=1 ! \
+                video/x-raw,width=1282,height=722,format=${input_format} ! \
+                jpegenc ! filesink location="${base}.jpg" >/dev/null 2>&1 ||
+            ! jpegtran -restart 1 -outfile "${base}_dri.jpg" "${base}.jpg"; then
+            echo "Could not create restart-marker JPEG from ${input_format}"
+            continue
+        fi
+
+        for output_format in I420 RGB; do
+            run_compare_test "${input_format} → ${output_format} slice-threads=4" \
+                "${source} ! turbojpegdec slice-threads=4 ! video/x-raw,format=${output_format}" \
+                "${source} ! turbojpegdec slice-threads=1 ! video/x-raw,format=${output_format}" \
+                exact
+        done
+
+        # Planar RGB is band-decoded at restart markers even without
+        # slice threads, against a whole-frame packed decode
+        run_compare_test "${input_format} → GBR restart bands" \
+            "${source} ! turbojpegdec ! video/x-raw,format=GBR" \
+            "${source} ! turbojpegdec ! video/x-raw,format=RGB ! videoconvert ! video/x-raw,format=GBR" \
+            exact
+    done
+}
+
+# Chroma subsampling of a YUV format, to tell repacks from resampling
+chroma_class() {
+    case "$1" in
+        I420|YV12|NV12|NV21) echo 420 ;;
+        Y42B|YUY2|UYVY) echo 422 ;;
+        *) echo 444 ;;
+    esac
+}
+
+# Decoded pixels of every output path against a reference: the JPEG's own
+# planes through videoconvert, or a full decode cropped or scaled
+# afterwards. Repacks and optional paths have to match closely, while the
+# decoder's chroma resamplers and the IDCT scaling only have to agree with
+# videoconvert and videoscale within their different filters
+test_reference_outputs() {
+    echo -e "\n${BLUE}=== Reference Output Tests ===${NC}"
+
+    for input_combo in "${INPUT_FORMATS[@]}"; do
+        IFS=':' read -r input_format expected_subsamp input_desc <<< "$input_combo"
+        local jpeg_file="${OUTPUT_DIR}/reference_${input_format}.jpg"
+        local source="filesrc location=${jpeg_file} ! jpegparse"
+
+        if ! gst-launch-1.0 -q videotestsrc pattern=${TEST_PATTERN} num-buffers=1 ! \
+                video/x-raw,width=642,height=482,format=${input_format} ! \
+                jpegenc ! filesink location="$jpeg_file" >/dev/null 2>&1; then
+            echo "Could not create reference JPEG from ${input_format}"
+            continue
+        fi
+
+        for output_format in "${OUTPUT_FORMATS[@]}"; do
+            local min_psnr=35
+            if [[ $(chroma_class "$input_format") == $(chroma_class "$output_format") ]]; then
+                min_psnr=45
+            fi
+            run_compare_test "${input_format} → ${output_format} pixels" \
+                "${source} ! turbojpegdec ! video/x-raw,format=${output_format}" \
+                "${source} ! turbojpegdec ! video/x-raw,format=${input_format} ! videoconvert ! video/x-raw,format=${output_format}" \
+                "$min_psnr"
+        done
+
+        for output_format in RGBA ARGB GBR; do
+            run_compare_test "${input_format} → ${output_format} pixels" \
+                "${source} ! turbojpegdec ! video/x-raw,format=${output_format}" \
+                "${source} ! turbojpegdec ! video/x-raw,format=RGB ! videoconvert ! video/x-raw,format=${output_format}" \
+                45
+        done
+    done
+
+    local source="filesrc location=${OUTPUT_DIR}/reference_I420.jpg ! jpegparse"
+
+    run_compare_test "ROI against videocrop" \
+        "${source} ! turbojpegdec roi-x=64 roi-y=32 roi-width=320 roi-height=240 ! video/x-raw,format=I420" \
+        "${source} ! turbojpegdec ! video/x-raw,format=I420 ! videocrop left=64 top=32 right=258 bottom=210" \
+        45
+    run_compare_test "scale=1/2 against videoscale" \
+        "${source} ! turbojpegdec scale=1/2 ! video/x-raw,format=I420" \
+        "${source} ! turbojpegdec ! video/x-raw,format=I420 ! videoscale ! video/x-raw,width=321,height=241" \
+        25
+
+    # A static pattern gives identical JPEGs, which the cache and the
+    # duplicate detection serve without decoding them again
+    local stream="videotestsrc pattern=${TEST_PATTERN} num-buffers=6 ! \
+        video/x-raw,width=642,height=482,format=I420 ! jpegenc"
+    local option
+    for option in cache-size=4 skip-duplicates=true lazy-decode=true; do
+        run_compare_test "${option} pixels" \
+            "${stream} ! turbojpegdec ${option} ! video/x-raw,format=I420" \
+            "${stream} ! turbojpegdec ! video/x-raw,format=I420" \
+            exact
+    done
+
+    # 16-bit output of a 12-bit JPEG, against the image it was made from
+    if command -v cjpeg >/dev/null; then
+        local raw_file="${OUTPUT_DIR}/reference_12bit.rgb"
+        local ppm_file="${OUTPUT_DIR}/reference_12bit.ppm"
+        local jpeg12_file="${OUTPUT_DIR}/reference_12bit.jpg"
+
+        if gst-launch-1.0 -q videotestsrc pattern=${TEST_PATTERN} num-buffers=1 ! \
+                video/x-raw,width=640,height=480,format=RGB ! \
+                filesink location="$raw_file" >/dev/null 2>&1 &&
+            { printf 'P6\n640 480\n255\n'; cat "$raw_file"; } > "$ppm_file" &&
+            cjpeg -precision 12 -quality 95 -sample 1x1 \
+                -outfile "$jpeg12_file" "$ppm_file" 2>/dev/null; then
+            run_compare_test "12-bit → ARGB64 pixels" \
+                "filesrc location=${jpeg12_file} ! jpegparse ! turbojpegdec ! video/x-raw,format=ARGB64 ! videoconvert dither=none ! video/x-raw,format=RGB" \
+                "filesrc location=${raw_file}" \
+                35
+        else
+            echo -e "${YELLOW}cjpeg cannot write 12-bit JPEGs, skipping 16-bit output${NC}"
+        fi
+    else
+        echo -e "${YELLOW}cjpeg not found, skipping 16-bit output${NC}"
+    fi
+}
+
 # Performance test
 test_performance() {
     echo -e "\n${BLUE}=== Performance Test ===${NC}"
@@ -205,22 +524,38 @@ test_performance() {
 # Main test execution
 echo -e "${BLUE}=== YUV Format Combination Tests ===${NC}"
 
-# Test all YUV combinations
-for input_combo in "${INPUT_FORMATS[@]}"; do
-    IFS=':' read -r input_format expected_subsamp input_desc <<< "$input_combo"
-    
-    echo -e "\n${YELLOW}Input: ${input_format} (${input_desc})${NC}"
-    
-    for output_format in "${OUTPUT_FORMATS[@]}"; do
-        run_test "$input_format" "$expected_subsamp" "$input_desc" "$output_format"
+# Test all YUV combinations at every size
+for test_size in "${TEST_SIZES[@]}"; do
+    IFS='x' read -r TEST_WIDTH TEST_HEIGHT <<< "$test_size"
+
+    for input_combo in "${INPUT_FORMATS[@]}"; do
+        IFS=':' read -r input_format expected_subsamp input_desc <<< "$input_combo"
         
-        # Quick mode: only test I420 output for non-I420 inputs
-        if [[ "$QUICK_MODE" == true && "$output_format" == "I420" && "$input_format" != "I420" ]]; then
-            break
-        fi
+        echo -e "\n${YELLOW}Input: ${input_format} ${test_size} (${input_desc})${NC}"
+        
+        for output_format in "${OUTPUT_FORMATS[@]}"; do
+            run_test "$input_format" "$expected_subsamp" "$input_desc" "$output_format"
+            
+            # Quick mode: only test I420 output for non-I420 inputs
+            if [[ "$QUICK_MODE" == true && "$output_format" == "I420" && "$input_format" != "I420" ]]; then
+                break
+            fi
+        done
     done
 done
 
+# Test the JPEG-to-JPEG elements
+test_jpeg_elements
+
+# Test automatic DCT scaling
+test_auto_scale
+
+# Test restart-marker slice decoding
+test_slices
+
+# Test decoded pixels against reference pipelines
+test_reference_outputs
+
 # Test RGB formats
 if [[ "$QUICK_MODE" == false ]]; then
     echo -e "\n${BLUE}=== RGB Reference Tests ===${NC}"